@@ -0,0 +1,216 @@
+// Microbenchmarks of square's hot paths: transforms, mesh generation, text layout, object tree traversal, and buffer
+// writes.
+//
+// Usage: square_bench [output.json] [filter]
+//
+// Each benchmark is calibrated so one sample runs for at least 10ms, then timed for a fixed number of samples. Results
+// are reported in nanoseconds per operation as JSON, to stdout or to output.json if it is given. If filter is given,
+// only benchmarks with names containing filter are run.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+import square;
+import squint;
+
+using namespace square;
+using namespace squint;
+using namespace squint::quantities;
+
+// keeps the compiler from optimizing away the result of benchmarked code
+template <typename T> inline void do_not_optimize(const T &value) { asm volatile("" : : "r,m"(value) : "memory"); }
+
+// HARNESS -------------------------------------------------------------------------------------------------------------
+struct bench_result {
+    std::string name;
+    uint64_t iterations; // operations per sample
+    double median_ns;    // nanoseconds per operation
+    double min_ns;
+    double max_ns;
+};
+class bench_runner {
+  public:
+    bench_runner(std::string filter) : filter(std::move(filter)) {}
+    template <typename F> void run(const std::string &name, F &&op) {
+        if (!filter.empty() && name.find(filter) == std::string::npos) {
+            return;
+        }
+        auto time = [&op](uint64_t iterations) {
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < iterations; i++) {
+                op();
+            }
+            return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        };
+        // calibrating also warms up the caches
+        uint64_t iterations = 1;
+        while (time(iterations) < min_sample_ns && iterations < max_iterations) {
+            iterations *= 2;
+        }
+        std::vector<double> samples(sample_count);
+        for (auto &sample : samples) {
+            sample = time(iterations) / static_cast<double>(iterations);
+        }
+        std::sort(samples.begin(), samples.end());
+        results.push_back({name, iterations, samples[sample_count / 2], samples.front(), samples.back()});
+        std::cerr << name << ": " << results.back().median_ns << " ns/op" << std::endl;
+    }
+    void write_json(std::ostream &os) const {
+        os << "{\n  \"context\": {\"hardware_threads\": " << std::thread::hardware_concurrency()
+           << ", \"samples\": " << sample_count << "},\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const auto &result = results[i];
+            os << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << result.name
+               << "\", \"iterations\": " << result.iterations << ", \"median_ns\": " << result.median_ns
+               << ", \"min_ns\": " << result.min_ns << ", \"max_ns\": " << result.max_ns << "}";
+        }
+        os << "\n  ]\n}\n";
+    }
+
+  private:
+    static constexpr size_t sample_count = 15;
+    static constexpr double min_sample_ns = 10e6;
+    static constexpr uint64_t max_iterations = uint64_t{1} << 30;
+    std::string filter;
+    std::vector<bench_result> results;
+};
+
+// OBJECT TREES --------------------------------------------------------------------------------------------------------
+template <typename T> class bench_node_physics_system : public physics_system<T> {
+  public:
+    void update(time_f dt, T &node) const override { node.t += dt; }
+};
+class bench_node : public entity<bench_node> {
+  public:
+    bench_node() { attach_physics_system<bench_node_physics_system>(); }
+    time_f t{0.f};
+};
+// build a tree of node_count nodes, breadth first, where every node has up to fan_out children
+std::unique_ptr<bench_node> build_tree(size_t node_count, size_t fan_out) {
+    auto root = std::make_unique<bench_node>();
+    std::deque<bench_node *> parents{root.get()};
+    size_t count = 1;
+    while (count < node_count) {
+        bench_node *parent = parents.front();
+        parents.pop_front();
+        for (size_t i = 0; i < fan_out && count < node_count; i++, count++) {
+            parents.push_back(parent->gen_object<bench_node>());
+        }
+    }
+    return root;
+}
+
+// BENCHMARKS ----------------------------------------------------------------------------------------------------------
+// benchmarks that don't need a rendering context
+void run_cpu_benchmarks(bench_runner &runner) {
+    transform t{};
+    fvec3 axis({0.f, 1.f, 0.f});
+    runner.run("transform/rotate", [&]() {
+        t.rotate(axis, 0.001f);
+        do_not_optimize(t);
+    });
+    runner.run("transform/set_scale", [&]() {
+        t.set_scale(fvec3({2.f, 2.f, 2.f}));
+        do_not_optimize(t);
+    });
+    runner.run("transform/get_view_matrix", [&]() { do_not_optimize(t.get_view_matrix()); });
+    runner.run("transform/get_normal_matrix", [&]() { do_not_optimize(t.get_normal_matrix()); });
+
+    for (size_t node_count : {size_t{1000}, size_t{10000}, size_t{100000}, size_t{1000000}}) {
+        auto root = build_tree(node_count, 8);
+        std::string nodes = std::to_string(node_count);
+        runner.run("object/update/" + nodes, [&]() { root->update(time_f{1.f / 60.f}); });
+        runner.run("object/prune/" + nodes, [&]() { root->prune(); });
+    }
+}
+// benchmarks of code that creates GL objects, run from a renderer once its context is created
+void run_gl_benchmarks(bench_runner &runner) {
+    for (int sides : {8, 64, 512}) {
+        runner.run("mesh/circle/" + std::to_string(sides),
+                   [&]() { do_not_optimize(std::make_unique<circle_mesh>(sides, 1.f)); });
+        runner.run("mesh/cylinder/" + std::to_string(sides),
+                   [&]() { do_not_optimize(std::make_unique<cylinder_mesh>(0.f, 6.283f, sides)); });
+    }
+    for (unsigned int recursion : {1u, 3u, 5u}) {
+        runner.run("mesh/icosphere/" + std::to_string(recursion),
+                   [&]() { do_not_optimize(std::make_unique<sphere_mesh>(recursion, 1.f)); });
+    }
+    for (size_t divisions : {size_t{8}, size_t{64}, size_t{256}}) {
+        runner.run("mesh/uv_sphere/" + std::to_string(divisions),
+                   [&]() { do_not_optimize(std::make_unique<sphere_mesh>(divisions, divisions, 1.f)); });
+    }
+    for (unsigned int divisions : {8u, 64u, 256u}) {
+        runner.run("mesh/torus/" + std::to_string(divisions),
+                   [&]() { do_not_optimize(std::make_unique<torus_mesh>(divisions, 2 * divisions, 0.5f, 1.f)); });
+    }
+    runner.run("mesh/cube", [&]() { do_not_optimize(std::make_unique<cube_mesh>(1.f)); });
+    runner.run("mesh/square", [&]() { do_not_optimize(std::make_unique<square_mesh>()); });
+    runner.run("mesh/line", [&]() { do_not_optimize(std::make_unique<line_mesh>(0.1f)); });
+
+    std::string short_text = "fps 60.0";
+    std::string long_text = "The quick brown fox jumps over the lazy dog\n0123456789 !@#$%^&*()\nSQUARE square";
+    char_mesh text(" ", 0.f, 0.f, 1024);
+    bool flip = false;
+    runner.run("char_mesh/set_text/short", [&]() {
+        text.set_text(flip ? short_text : "fps 59.9");
+        flip = !flip;
+    });
+    runner.run("char_mesh/set_text/long", [&]() {
+        text.set_text(flip ? long_text : short_text);
+        flip = !flip;
+    });
+
+    constexpr size_t element_count = 1024;
+    auto storage = app::renderer()->gen_buffer(nullptr, sizeof(fmat4) * element_count,
+                                               {{buffer_attribute_type::STORAGE, "models"}},
+                                               buffer_access_type::WRITE_ONLY);
+    std::vector<fmat4> matrices(element_count, fmat4::I());
+    runner.run("buffer/write_elements/1024", [&]() { storage->write_elements(0, matrices); });
+    instanced_mesh instances(std::make_unique<square_mesh>(), element_count);
+    runner.run("buffer/push_instance/1024", [&]() {
+        instances.clear_instances();
+        for (size_t i = 0; i < element_count; i++) {
+            instances.push_instance(transform(matrices[i]));
+        }
+    });
+}
+
+// RENDERER ------------------------------------------------------------------------------------------------------------
+// runs the GL benchmarks once its context has been created, then detaches itself
+class bench_renderer : public sdl_gl_renderer {
+  public:
+    bench_renderer(bench_runner *runner) : runner(runner) {
+        properties.window_title = "square_bench";
+        properties.window_width = 64;
+        properties.window_height = 64;
+        properties.headless = true;
+        properties.debug = debug_mode::OFF;
+    }
+    void on_enter() override {
+        run_gl_benchmarks(*runner);
+        destroy();
+    }
+    bench_runner *runner;
+};
+
+int main(int argc, char **argv) {
+    bench_runner runner(argc > 2 ? argv[2] : "");
+    run_cpu_benchmarks(runner);
+    sdl_gl_renderer::init(true);
+    app::attach_renderer<bench_renderer>(&runner);
+    app::run();
+    sdl_gl_renderer::quit();
+    if (argc > 1) {
+        std::ofstream file(argv[1]);
+        runner.write_json(file);
+    } else {
+        runner.write_json(std::cout);
+    }
+    return 0;
+}
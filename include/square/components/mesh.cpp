@@ -1,14 +1,115 @@
 module;
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <vector>
 export module square:mesh;
 import :transform;
 import :entity;
 import :renderer;
 import :material;
+import :thread_pool;
+import :profiler;
+import :task;
 import squint;
 
 export namespace square {
+class simple_mesh;
+class instanced_mesh;
+// A draw recorded for the render thread to submit
+struct draw_packet {
+    const simple_mesh *simple;       // the mesh drawn if it is not instanced
+    const instanced_mesh *instanced; // the mesh drawn if it is instanced
+    unsigned int instance_count;
+    material *mat;
+    texture2D *texture; // bound with material::set_texture() if not nullptr
+    transform model;
+};
+// A list of draws recorded without calling the rendering API, so the CPU work of preparing them, e.g. computing the
+// model matrices of composite meshes, can run on worker threads. The render thread submits the list in the order the
+// draws were recorded, activating a material and binding a texture only when they change between draws.
+//
+// A list may be recorded by one thread at a time. Use record_parallel() to record into a list from app::jobs(). The
+// meshes, materials and textures must outlive the submission and instance counts are read when a draw is recorded.
+class draw_list {
+  public:
+    // the texture of the draws recorded after this call
+    inline void set_texture(texture2D *tex) { texture = tex; }
+    void draw(const simple_mesh *m, material *mat, const squint::fmat4 &model) {
+        packets.push_back({m, nullptr, 0, mat, texture, transform(model)});
+    }
+    void draw(const instanced_mesh *m, material *mat, const squint::fmat4 &model, unsigned int instance_count) {
+        packets.push_back({nullptr, m, instance_count, mat, texture, transform(model)});
+    }
+    // append the draws of another list after the draws of this one
+    void append(const draw_list &list) { packets.insert(packets.end(), list.packets.begin(), list.packets.end()); }
+    // Call record(begin, end, list) for ranges of the indices up to count on the job threads and the calling thread,
+    // each recording into a list of its own, then append the lists in the order of their ranges. The draws are
+    // recorded in the same order as by record(0, count, *this). record() sees the active renderer and task scheduler
+    // of the calling thread, e.g. to read double_buffered state, but must not call the rendering API. Rethrows the
+    // first exception thrown by record(). Can be called from a job, see parallel_for().
+    template <typename F> void record_parallel(size_t count, F &&record, size_t min_range = 256) {
+        profile_zone zone("record_parallel");
+        size_t ranges = std::clamp<size_t>(count / std::max<size_t>(min_range, 1), 1, app::jobs().size() + 1);
+        if (ranges == 1) {
+            record(size_t{0}, count, *this);
+            return;
+        }
+        // the range lists are kept so their packets don't have to be allocated again every frame
+        range_lists.resize(ranges);
+        for (auto &list : range_lists) {
+            list.clear();
+            list.texture = texture;
+        }
+        auto in_job = [r = app::renderer(), scheduler = task_scheduler::active()](auto &&job) {
+            app::scoped_active_renderer active(r, scheduler);
+            job();
+        };
+        parallel_for(app::jobs(), ranges, in_job, [this, &record, count, ranges](size_t i) {
+            record(count * i / ranges, count * (i + 1) / ranges, range_lists[i]);
+        });
+        for (const auto &list : range_lists) {
+            append(list);
+        }
+        texture = range_lists.back().texture;
+    }
+    // draw the recorded draws with the active renderer, which must be called on the render thread
+    void submit() const {
+        profile_zone zone("submit_draws");
+        renderer *r = app::renderer();
+        material *active_mat = nullptr;
+        texture2D *bound_texture = nullptr;
+        for (const auto &packet : packets) {
+            if (packet.mat != active_mat) {
+                if (!packet.mat->activate()) {
+                    continue;
+                }
+                active_mat = packet.mat;
+                bound_texture = nullptr;
+            }
+            if (packet.texture && packet.texture != bound_texture) {
+                active_mat->set_texture(packet.texture);
+                bound_texture = packet.texture;
+            }
+            if (packet.simple) {
+                r->draw_mesh(packet.simple, &packet.model, active_mat);
+            } else {
+                r->draw_mesh(packet.instanced, &packet.model, active_mat, packet.instance_count);
+            }
+        }
+    }
+    void clear() {
+        packets.clear();
+        texture = nullptr;
+    }
+    inline size_t size() const { return packets.size(); }
+    inline const std::vector<draw_packet> &get_packets() const { return packets; }
+
+  private:
+    std::vector<draw_packet> packets{};
+    texture2D *texture = nullptr;
+    std::vector<draw_list> range_lists{};
+};
 // A simple mesh contains a transform (or model matrix) along with a vertex buffer and possibly an index buffer. The
 // vertex buffer must be compatible with any shader bound to the mesh in order to be rendered successfully. This means
 // that any inputs to the vertex shader should be available as buffer attributes in the vertex buffer.
@@ -33,10 +134,16 @@ class simple_mesh : public mesh {
     virtual void draw(material *mat) override final { app::renderer()->draw_mesh(this, this, mat); }
     // Draws the mesh using the bound shader and a parent transform. The shader must be active.
     virtual void draw(material *mat, const transform *parent) override final {
-        transform model;
-        model.set_transformation_matrix(parent->get_transformation_matrix() * this->get_transformation_matrix());
+        transform model(parent->get_transformation_matrix() * this->get_transformation_matrix());
         app::renderer()->draw_mesh(this, &model, mat);
     }
+    virtual void record(draw_list &list, material *mat, const transform *parent = nullptr) const override final {
+        if (parent) {
+            list.draw(this, mat, parent->get_transformation_matrix() * this->get_transformation_matrix());
+        } else {
+            list.draw(this, mat, this->get_transformation_matrix());
+        }
+    }
     inline const vertex_input_assembly *get_input_assembly() const { return input_assembly.get(); }
     inline vertex_input_assembly *get_input_assembly() { return input_assembly.get(); }
     inline draw_method get_draw_method() const { return method; }
@@ -65,17 +172,22 @@ class instanced_mesh : public mesh {
     }
     // Draws the mesh using the bound shader. The shader must be active and must be the shader that was bound.
     virtual void draw(material *mat) override final {
-        transform model;
-        model.set_transformation_matrix(this->get_transformation_matrix() * base_mesh->get_transformation_matrix());
+        transform model(this->get_transformation_matrix() * base_mesh->get_transformation_matrix());
         app::renderer()->draw_mesh(this, &model, mat, instance_count);
     }
     // Draws the mesh using the bound shader and a parent transform. The shader must be active.
     virtual void draw(material *mat, const transform *parent) override final {
-        transform model;
-        model.set_transformation_matrix(parent->get_transformation_matrix() * this->get_transformation_matrix() *
-                                        base_mesh->get_transformation_matrix());
+        transform model(parent->get_transformation_matrix() * this->get_transformation_matrix() *
+                        base_mesh->get_transformation_matrix());
         app::renderer()->draw_mesh(this, &model, mat, instance_count);
     }
+    virtual void record(draw_list &list, material *mat, const transform *parent = nullptr) const override final {
+        squint::fmat4 model = this->get_transformation_matrix() * base_mesh->get_transformation_matrix();
+        if (parent) {
+            model = parent->get_transformation_matrix() * model;
+        }
+        list.draw(this, mat, model, instance_count);
+    }
     inline const vertex_input_assembly *get_input_assembly() const {
         if (base_mesh) {
             return base_mesh->get_input_assembly();
@@ -131,12 +243,18 @@ class composite_mesh : public mesh {
         }
     }
     virtual void draw(material *mat, const transform *parent) override final {
-        transform model;
-        model.set_transformation_matrix(parent->get_transformation_matrix() * this->get_transformation_matrix());
+        transform model(parent->get_transformation_matrix() * this->get_transformation_matrix());
         for (auto &mesh : meshes) {
             mesh->draw(mat, &model);
         }
     }
+    virtual void record(draw_list &list, material *mat, const transform *parent = nullptr) const override final {
+        transform model(parent ? parent->get_transformation_matrix() * this->get_transformation_matrix()
+                               : this->get_transformation_matrix());
+        for (auto &mesh : meshes) {
+            mesh->record(list, mat, &model);
+        }
+    }
 
   private:
     std::vector<std::unique_ptr<mesh>> meshes;
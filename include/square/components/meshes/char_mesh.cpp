@@ -133,21 +133,20 @@ class char_mesh : public composite_mesh {
         squint::fvec3 position({label_top_left[0].data()[0], label_top_left[1].data()[0], 0.0f});
         set_position(position.view_as<squint::quantities::length_f>());
     }
-    void set_text(std::string str) {
-        if (!is_static) {
-            std::string old_string = text;
-            text = str;
-            lines = 0;
-            max_width = 0;
-            stroke_count = 0;
-            nodes->clear_instances();
-            links->clear_instances();
-            if (push_instances(str)) {
-                return;
-            }
-            push_instances(old_string);
-            text = old_string;
+    // Replace the text. The text is not changed if it would need more strokes than max_strokes or the mesh was
+    // constructed with max_strokes of zero. Setting text never allocates GPU memory, so this can be called every frame.
+    void set_text(const std::string &str) {
+        if (is_static || count_strokes(str) > max_strokes) {
+            return;
         }
+        text = str;
+        lines = 0;
+        max_width = 0;
+        stroke_count = 0;
+        nodes->clear_instances();
+        links->clear_instances();
+        push_instances(text);
+        mark_scene_changed();
     }
     std::string get_text() { return text; }
 
@@ -164,7 +163,7 @@ class char_mesh : public composite_mesh {
     instanced_mesh *links;
     float grid_points[17] = {0.0f,    0.0625f, 0.125f,  0.1875f, 0.25f,   0.3125f, 0.375f,  0.4375f, 0.5f,
                              0.5625f, 0.625f,  0.6875f, 0.75f,   0.8125f, 0.875f,  0.9375f, 1.0f};
-    std::unordered_map<char, std::vector<unsigned int>> ASCII_font = {
+    inline static const std::unordered_map<char, std::vector<unsigned int>> ASCII_font = {
         {'!', std::vector<unsigned int>{8, 2, 8, 11, 8, 13, 8, 14}},
         {'"', std::vector<unsigned int>{5, 2, 5, 4, 11, 2, 11, 4}},
         {'#', std::vector<unsigned int>{7, 2, 3, 14, 13, 2, 9, 14, 2, 5, 14, 5, 2, 11, 14, 11}},
@@ -276,19 +275,22 @@ class char_mesh : public composite_mesh {
                                         11, 8, 9, 9, 9, 9, 9, 12, 9, 12, 8, 14, 8, 14, 6,  14}},
         {'~', std::vector<unsigned int>{2,  10, 2,  8,  2,  8,  4,  6,  4,  6, 6,  6, 6,  6,
                                         10, 10, 10, 10, 12, 10, 12, 10, 14, 8, 14, 8, 14, 6}}};
-    unsigned int count_strokes(std::string str) {
-        std::vector<unsigned int> indices{};
-        for (auto &c : str) {
-            for (auto i : ASCII_font[c]) {
-                indices.push_back(i);
-            }
+    // line indices of a character, characters without strokes such as ' ' have no indices
+    static const std::vector<unsigned int> &glyph(char c) {
+        static const std::vector<unsigned int> empty{};
+        auto it = ASCII_font.find(c);
+        return it != ASCII_font.end() ? it->second : empty;
+    }
+    static unsigned int count_strokes(const std::string &str) {
+        size_t index_count = 0;
+        for (char c : str) {
+            index_count += glyph(c).size();
         }
-        return indices.size() / 4;
+        return static_cast<unsigned int>(index_count / 4);
     }
     void push_char(unsigned int column, unsigned int row, char letter) {
-        std::vector<squint::fmat4> transforms{};
         squint::fvec3 offset = squint::fvec3({0.5f * static_cast<float>(column), -static_cast<float>(row), 0.0f});
-        std::vector<unsigned int> indices = ASCII_font[letter];
+        const std::vector<unsigned int> &indices = glyph(letter);
         for (size_t i = 0; i < indices.size() / 4; i++) {
 
             squint::fvec3 p1 = {0.5f * grid_points[indices[4 * i]], -grid_points[indices[4 * i + 1]], 0.0f};
@@ -331,7 +333,7 @@ class char_mesh : public composite_mesh {
             stroke_count++;
         }
     }
-    bool push_instances(std::string str) {
+    bool push_instances(const std::string &str) {
         if (max_strokes >= count_strokes(str)) {
             unsigned int column = 0;
             unsigned int row = 0;
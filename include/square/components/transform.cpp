@@ -1,7 +1,9 @@
 module;
+#include <algorithm>
 #include <concepts>
 export module square:transform;
 import :entity;
+import :system;
 import squint;
 
 using namespace squint::quantities;
@@ -38,6 +40,8 @@ concept transformable = requires(T t) {
 //
 // Technically this matrix would have mixed dimension with the fourth column having dimension of length and the
 // remaining columns being dimensionless, but internally it is stored as a dimensionless matrix.
+//
+// Changing a transform marks the scene as changed so on-demand renderers draw it, see mark_scene_changed().
 class transform {
   public:
     transform();
@@ -63,6 +67,8 @@ class transform {
     squint::fvec3 get_up_vector() const;
 
   private:
+    // set the matrix and mark the scene as changed if it is different
+    void assign(const squint::fmat4 &matrix);
     squint::fmat4 transformation_matrix;
 };
 
@@ -93,35 +99,45 @@ fmat4 transform::get_rotation_matrix() const {
     return rotation;
 }
 fmat4 transform::get_scale_matrix() const { return scale(fmat4::I(), get_scale()); }
-void transform::set_transformation_matrix(const fmat4 &transformation_matrix) {
-    this->transformation_matrix = transformation_matrix;
+void transform::assign(const fmat4 &matrix) {
+    check_access<transform>(true);
+    if (!std::equal(matrix.data(), matrix.data() + 16, transformation_matrix.data())) {
+        transformation_matrix = matrix;
+        mark_scene_changed();
+    }
 }
+void transform::set_transformation_matrix(const fmat4 &transformation_matrix) { assign(transformation_matrix); }
 fmat3 transform::get_normal_matrix() const { return inv(transformation_matrix.at<3, 3>(0, 0)).transpose(); }
 fmat4 transform::get_view_matrix() const { return inv(transformation_matrix); }
 void transform::face_towards(const tensor<length_f, 3> &point, const fvec3 &up) {
     auto view = squint::look_at(get_position().view_as<const float>(), point.view_as<const float>(), up.as_ref());
-    transformation_matrix = inv(view) * get_scale_matrix();
+    assign(inv(view) * get_scale_matrix());
 }
 void transform::translate(const tensor<length_f, 3> &offset) {
-    transformation_matrix.at<3>(0, 3) += offset.view_as<const float>();
+    // assigned so a zero offset, e.g. a resting velocity, doesn't mark the scene changed
+    fmat4 matrix = transformation_matrix;
+    matrix.at<3>(0, 3) += offset.view_as<const float>();
+    assign(matrix);
 }
 void transform::set_position(const tensor<length_f, 3> &position) {
-    transformation_matrix.at<3>(0, 3) = position.view_as<const float>();
+    fmat4 matrix = transformation_matrix;
+    matrix.at<3>(0, 3) = position.view_as<const float>();
+    assign(matrix);
 }
 void transform::rotate(const fvec3 &axis, float angle) {
     fmat4 rotation = squint::rotate(fmat4::I(), angle, axis) * get_rotation_matrix();
-    transformation_matrix = get_translation_matrix() * rotation * get_scale_matrix();
+    assign(get_translation_matrix() * rotation * get_scale_matrix());
 }
 void transform::set_rotation(const fvec3 &axis, float angle) {
     fmat4 rotation = squint::rotate(fmat4::I(), angle, axis);
-    transformation_matrix = get_translation_matrix() * rotation * get_scale_matrix();
+    assign(get_translation_matrix() * rotation * get_scale_matrix());
 }
 void transform::set_rotation_matrix(const fmat4 &rotation_matrix) {
-    transformation_matrix = get_translation_matrix() * rotation_matrix * get_scale_matrix();
+    assign(get_translation_matrix() * rotation_matrix * get_scale_matrix());
 }
 void transform::set_scale(const fvec3 &scale) {
     fmat4 scale_matrix = squint::scale(fmat4::I(), scale);
-    transformation_matrix = get_translation_matrix() * get_rotation_matrix() * scale_matrix;
+    assign(get_translation_matrix() * get_rotation_matrix() * scale_matrix);
 }
 fvec3 transform::get_forward_vector() const {
     auto rotation_matrix = get_rotation_matrix();
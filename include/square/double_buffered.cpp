@@ -0,0 +1,57 @@
+module;
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+export module square:double_buffered;
+import :renderer;
+
+export namespace square {
+// State written by update() and read by render(), for renderers with properties.pipelined_update.
+//
+// With pipelined updates the next frame is simulated on a worker thread while the current one is rendered, so the two
+// must not share state. A double_buffered value keeps two copies. update() writes one while render() reads the other,
+// which holds the state of the last completed update. The first write() of a frame copies that state, so values that
+// aren't written every frame stay current. Without pipelined updates the state is published right after update(), so
+// render() reads what update() wrote in the same frame.
+//
+// The frame is that of the active renderer of the calling thread. Without an active renderer, e.g. while a scene is
+// constructed, writes belong to frame 0 and are read once the renderer's first update has completed.
+template <typename T> class double_buffered {
+  public:
+    double_buffered() : double_buffered(T{}) {}
+    double_buffered(const T &value) : values{value, value} {}
+    double_buffered(const double_buffered &) = delete;
+    double_buffered &operator=(const double_buffered &) = delete;
+    // the state being simulated, written by update()
+    T &write() { return write(current_frame()); }
+    // the state of the last completed update, read by render()
+    const T &read() const { return read(current_frame()); }
+    // write() and read() in a frame, the number of updates published by the renderer when they are called
+    T &write(uint64_t frame) {
+        uint64_t written = state.load(std::memory_order_acquire);
+        size_t slot = written & 1;
+        if (written >> 1 != frame) {
+            // start this frame's state from the latest published state, in the copy render() isn't reading
+            values[1 - slot] = values[slot];
+            slot = 1 - slot;
+            state.store(frame << 1 | slot, std::memory_order_release);
+        }
+        return values[slot];
+    }
+    const T &read(uint64_t frame) const {
+        uint64_t written = state.load(std::memory_order_acquire);
+        size_t slot = written & 1;
+        // the copy written in the current frame is still being simulated
+        return values[written >> 1 < frame ? slot : 1 - slot];
+    }
+
+  private:
+    static uint64_t current_frame() {
+        renderer *r = app::renderer();
+        return r ? r->get_published_frame() : 0;
+    }
+    T values[2];
+    // the frame of the last write() shifted left by one, ored with the slot it wrote
+    std::atomic<uint64_t> state = 0;
+};
+} // namespace square
@@ -0,0 +1,58 @@
+module;
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+export module square:dynamic_resolution;
+import squint;
+
+export namespace square {
+// Chooses the scale of a renderer's internal resolution from measured GPU frame times so the GPU time per frame stays
+// under a target.
+//
+// GPU time is assumed to be proportional to the number of pixels rendered, so the scale of each dimension is adjusted
+// by the square root of the ratio of the target to the smoothed GPU time. The scale is only changed every few frames
+// and by a limited step so it doesn't oscillate, and it is lowered faster than it is raised so frame drops are short.
+class dynamic_resolution_controller {
+  public:
+    dynamic_resolution_controller(float min_scale = 0.5f, float max_scale = 1.f,
+                                  squint::quantities::time_f target_gpu_time = squint::quantities::time_f{1.f / 60.f})
+        : min_scale(std::min(min_scale, max_scale)), max_scale(max_scale),
+          target_ns(static_cast<double>(target_gpu_time.as_seconds()) * 1e9), scale(max_scale) {}
+    // record the GPU time of a frame and return the scale to render the next frames at
+    float update(int64_t gpu_time_ns) {
+        double sample = static_cast<double>(gpu_time_ns);
+        smoothed_ns = samples == 0 ? sample : smoothing * sample + (1.0 - smoothing) * smoothed_ns;
+        samples++;
+        if (++frames_since_change < adjust_period || smoothed_ns <= 0.0) {
+            return scale;
+        }
+        // aim below the target so small spikes don't miss it
+        float ideal = scale * static_cast<float>(std::sqrt(headroom * target_ns / smoothed_ns));
+        float next = std::clamp(ideal, scale - max_decrease, scale + max_increase);
+        next = std::clamp(next, min_scale, max_scale);
+        if (std::abs(next - scale) >= min_change) {
+            scale = next;
+            frames_since_change = 0;
+        }
+        return scale;
+    }
+    inline float get_scale() const { return scale; }
+    inline float get_min_scale() const { return min_scale; }
+    inline float get_max_scale() const { return max_scale; }
+
+  private:
+    inline static constexpr double smoothing = 0.2;    // weight of the newest sample in the smoothed GPU time
+    inline static constexpr double headroom = 0.9;     // fraction of the target GPU time aimed for
+    inline static constexpr int adjust_period = 8;     // frames between changes of the scale
+    inline static constexpr float max_decrease = 0.2f; // largest changes of the scale at once
+    inline static constexpr float max_increase = 0.05f;
+    inline static constexpr float min_change = 0.02f; // smaller changes are not worth the blurrier or sharper image
+    float min_scale;
+    float max_scale;
+    double target_ns;
+    float scale;
+    double smoothed_ns = 0.0;
+    size_t samples = 0;
+    int frames_since_change = 0;
+};
+} // namespace square
@@ -10,6 +10,7 @@ import :transform;
 import squint;
 
 export namespace square {
+class draw_list;
 // TODO: this can't be in mesh.cpp. Where should it go? Combine mesh and material into one file?
 // Abstract base class for all mesh types. All meshes are drawable and can be bound to a shader
 class mesh : public transform {
@@ -17,6 +18,8 @@ class mesh : public transform {
     virtual void bind_material(material *mat) = 0;
     virtual void draw(material *mat) = 0;
     virtual void draw(material *mat, const transform *parent) = 0;
+    // record the draws of the mesh into a draw_list instead of drawing it, e.g. from a worker thread
+    virtual void record(draw_list &list, material *mat, const transform *parent = nullptr) const = 0;
     virtual ~mesh() {}
 };
 // concept for templated systems
@@ -31,14 +34,9 @@ concept material_like = requires(T t) {
 template <material_like T> class material_render_system : public render_system<T> {
   public:
     void render(squint::quantities::time_f dt, T &mat) const override {
-        if (mat.get_camera()) {
-            if (auto s = mat.get_shader()) {
-                s->activate();
-                s->upload_mat4("projection", mat.get_camera()->get_projection_matrix());
-                s->upload_mat4("view", mat.get_camera()->get_view_matrix());
-                for (const auto &mesh : mat.get_meshes()) {
-                    mesh->draw(&mat);
-                }
+        if (mat.activate()) {
+            for (const auto &mesh : mat.get_meshes()) {
+                mesh->draw(&mat);
             }
         }
     }
@@ -50,6 +48,18 @@ class material : public entity<material> {
     material(const camera *cam) : cam(cam) { attach_render_system<material_render_system>(); }
     inline shader *get_shader() { return material_shader.get(); }
     inline const camera *get_camera() const { return cam; }
+    // activate the shader and upload the view and projection matrices, returns false if there is nothing to draw with
+    bool activate() {
+        if (cam && material_shader) {
+            material_shader->activate();
+            material_shader->upload_mat4("projection", cam->get_projection_matrix());
+            material_shader->upload_mat4("view", cam->get_view_matrix());
+            return true;
+        }
+        return false;
+    }
+    // bind the texture of the draw packets submitted with the material, see draw_list::set_texture()
+    virtual void set_texture(texture2D *tex) {}
     void set_model(const transform *model) {
         if (material_shader) {
             material_shader->upload_mat4("model", model->get_transformation_matrix());
@@ -58,6 +68,9 @@ class material : public entity<material> {
     inline std::vector<std::unique_ptr<mesh>> &get_meshes() { return meshes; }
 
   protected:
+    // release the shader when the material is unloaded so the program can be freed if no other material uses it.
+    // Derived materials generate their shader again in on_enter().
+    void on_exit() override { material_shader.reset(); }
     const camera *cam;
     std::unique_ptr<shader> material_shader;
     std::vector<std::unique_ptr<mesh>> meshes;
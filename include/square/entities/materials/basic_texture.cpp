@@ -16,11 +16,11 @@ export namespace square {
 class basic_texture : public material {
   public:
     basic_texture(camera *cam) : material(cam) {}
-    void set_texture(texture2D *tex) { get_shader()->upload_texture2D("tex", tex); }
+    void set_texture(texture2D *tex) override { get_shader()->upload_texture2D("tex", tex); }
     void on_enter() override {
         // we need to construct the shader here since we need the rendering API to be loaded first
-        material_shader = std::move(app::renderer()->gen_shader("basic_color", {{shader_type::VERTEX_SHADER,
-                                                                                 R"(
+        material_shader = std::move(app::renderer()->gen_shader("basic_texture", {{shader_type::VERTEX_SHADER,
+                                                                                   R"(
 #version 450
 
 in vec4 position;        // raw mesh model vertices
@@ -42,8 +42,8 @@ void main() {
   vert_tex_coords = tex_coords;
 }
           )"},
-                                                                                {shader_type::FRAGMENT_SHADER,
-                                                                                 R"(
+                                                                                  {shader_type::FRAGMENT_SHADER,
+                                                                                   R"(
 #version 450
 
 in vec2 vert_tex_coords;
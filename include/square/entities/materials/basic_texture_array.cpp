@@ -0,0 +1,106 @@
+module;
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+export module square:basic_texture_array;
+import :material;
+import :camera;
+import :renderer;
+import squint;
+
+export namespace square {
+// Vertex shader inputs:
+// in vec4 position;             // raw mesh model vertices
+// in vec2 tex_coords;           // texture coordinates of the whole image, remapped to the image's region
+// uniform sampler2DArray tex;   // texture array sampler
+// uniform mat4 projection;      // camera projection
+// uniform mat4 view;            // inverse camera transform
+// uniform mat4 model;           // mesh transform
+// buffer instance_regions;      // texture_region of each instance
+//
+// Instanced meshes with differently textured instances are drawn in one draw call by writing the texture_region of
+// each instance into a storage buffer and setting it with set_regions(). If the buffer holds fewer regions than there
+// are instances, the remaining instances use the last region.
+//
+// Objects with a single region use set_region() before they draw. Each region is kept in a buffer of its own, so
+// objects drawn in the same frame with different regions don't overwrite each other's region before the GPU reads it.
+class basic_texture_array : public material {
+  public:
+    basic_texture_array(camera *cam) : material(cam) {}
+    void set_texture(texture2D_array *tex) { get_shader()->upload_texture2D("tex", tex); }
+    // use one region for the meshes and instances drawn until the region is set again
+    void set_region(const texture_region &region) {
+        auto it = std::find_if(region_buffers.begin(), region_buffers.end(),
+                               [&region](const auto &entry) { return same_region(entry.first, region); });
+        if (it == region_buffers.end()) {
+            region_buffers.emplace_back(region, app::renderer()->gen_buffer(
+                                                    &region, sizeof(texture_region),
+                                                    {{buffer_attribute_type::STORAGE, "instance_regions"}},
+                                                    buffer_access_type::STATIC));
+            it = region_buffers.end() - 1;
+        }
+        set_regions(it->second.get());
+    }
+    // use a region per instance, indexed by the instance
+    void set_regions(const buffer *regions) { get_shader()->upload_storage_buffer("instance_regions", regions); }
+    void on_enter() override {
+        // we need to construct the shader here since we need the rendering API to be loaded first
+        material_shader = std::move(app::renderer()->gen_shader("basic_texture_array", {{shader_type::VERTEX_SHADER,
+                                                                                         R"(
+#version 450
+
+in vec4 position;        // raw mesh model vertices
+in vec2 tex_coords;      // texture coordinates
+uniform mat4 projection; // camera projection
+uniform mat4 view;       // inverse camera transform
+uniform mat4 model;      // mesh transform
+
+out vec3 vert_tex_coords; // output to the fragment shader
+
+struct texture_region {
+  vec4 uv_rect;
+  uint layer;
+};
+
+layout(std430, binding = 0) buffer model_instances { mat4 models[]; };
+layout(std430, binding = 1) buffer instance_regions { texture_region regions[]; };
+
+void main() {
+  if (models.length() == 0) {
+    gl_Position = projection * view * model * position;
+  } else {
+    gl_Position = projection * view * model * models[gl_InstanceID] * position;
+  }
+  texture_region region = regions[min(gl_InstanceID, regions.length() - 1)];
+  vert_tex_coords = vec3(region.uv_rect.xy + tex_coords * region.uv_rect.zw, float(region.layer));
+}
+          )"},
+                                                                                        {shader_type::FRAGMENT_SHADER,
+                                                                                         R"(
+#version 450
+
+in vec3 vert_tex_coords;
+uniform sampler2DArray tex;
+out vec4 color;
+
+void main() { color = texture(tex, vert_tex_coords); }
+      )"}}));
+        set_region(texture_region{squint::fvec4({0.f, 0.f, 1.f, 1.f}), 0});
+    }
+
+  protected:
+    void on_exit() override {
+        region_buffers.clear();
+        material::on_exit();
+    }
+
+  private:
+    static bool same_region(const texture_region &a, const texture_region &b) {
+        return a.layer == b.layer && a.uv_rect[0] == b.uv_rect[0] && a.uv_rect[1] == b.uv_rect[1] &&
+               a.uv_rect[2] == b.uv_rect[2] && a.uv_rect[3] == b.uv_rect[3];
+    }
+    // a single element storage buffer for each region that was set
+    std::vector<std::pair<texture_region, std::unique_ptr<buffer>>> region_buffers{};
+};
+} // namespace square
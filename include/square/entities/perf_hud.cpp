@@ -0,0 +1,180 @@
+module;
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <memory>
+#include <string>
+export module square:perf_hud;
+import :basic_color;
+import :camera;
+import :char_mesh;
+import :entity;
+import :histogram;
+import :mesh;
+import :renderer;
+import :square_mesh;
+import :system;
+import :transform;
+import squint;
+
+export namespace square {
+// Draws the text and frame time graph of a perf_hud. Text is refreshed a few times per second, the graph every frame.
+template <typename T> class perf_hud_render_system : public render_system<T> {
+  public:
+    void render(squint::quantities::time_f dt, T &display) const override {
+        display.refresh(dt);
+        if (auto r = app::renderer()) {
+            // the overlay is drawn over the scene
+            r->enable_depth_testing(false);
+            r->enable_face_culling(false);
+        }
+        display.mat->set_color(display.text_color);
+        display.text->draw(display.mat);
+        display.mat->set_color(display.graph_color);
+        display.bars->draw(display.mat);
+    }
+};
+// The text and graph of a perf_hud. All meshes are allocated when the display is loaded so drawing it does not
+// allocate.
+class perf_hud_display : public entity<perf_hud_display> {
+  public:
+    inline static constexpr size_t graph_samples = 120;
+    inline static constexpr unsigned int max_strokes = 2048;
+    perf_hud_display(basic_color *mat, const camera *cam) : mat(mat), cam(cam) {
+        attach_render_system<perf_hud_render_system>();
+        text_buffer.reserve(text_capacity);
+    }
+    void on_enter() override {
+        text = std::make_unique<char_mesh>(" ", 0.f, 0.f, max_strokes);
+        text->bind_material(mat);
+        bars = std::make_unique<instanced_mesh>(std::make_unique<square_mesh>(), graph_samples);
+        bars->bind_material(mat);
+        // write the text on the first frame
+        text_age = text_period;
+    }
+    void on_exit() override {
+        text.reset();
+        bars.reset();
+    }
+    // record the frame time and update the meshes
+    void refresh(squint::quantities::time_f dt) {
+        renderer *r = app::renderer();
+        frame_ms[next_sample] = dt.as_seconds() * 1000.f;
+        next_sample = (next_sample + 1) % graph_samples;
+        // the HUD is anchored to the top left corner of the view
+        float left = -cam->get_ortho_scale() * cam->get_aspect() + margin;
+        float top = cam->get_ortho_scale() - margin;
+        text_age += dt;
+        if (text_age.as_seconds() >= text_period.as_seconds()) {
+            text_age = squint::quantities::time_f{0.f};
+            write_text(*r);
+            text->set_text(text_buffer);
+        }
+        squint::fmat4 text_model = squint::translate(squint::fmat4::I(), squint::fvec3({left, top, 0.f})) *
+                                   squint::scale(squint::fmat4::I(), squint::fvec3({line_height, line_height, 1.f}));
+        text->set_transformation_matrix(text_model);
+        float graph_bottom = top - line_height * (text_lines + 0.5f) - graph_height;
+        float bar_width = graph_width / graph_samples;
+        bars->clear_instances();
+        for (size_t i = 0; i < graph_samples; i++) {
+            // oldest sample on the left, the graph is full height at graph_max_ms
+            float ms = frame_ms[(next_sample + i) % graph_samples];
+            float height = std::clamp(ms / graph_max_ms, 0.005f, 1.f) * graph_height;
+            squint::fvec3 center({left + (i + 0.5f) * bar_width, graph_bottom + 0.5f * height, 0.f});
+            squint::fvec3 size({0.8f * bar_width, height, 1.f});
+            bars->push_instance(transform(squint::translate(squint::fmat4::I(), center) *
+                                          squint::scale(squint::fmat4::I(), size)));
+        }
+    }
+    basic_color *mat;
+    const camera *cam;
+    std::unique_ptr<char_mesh> text;
+    std::unique_ptr<instanced_mesh> bars;
+    squint::fvec4 text_color{1.f, 1.f, 1.f, 1.f};
+    squint::fvec4 graph_color{0.2f, 0.9f, 0.3f, 1.f};
+
+  private:
+    void write_text(renderer &r) {
+        percentile_summary frame = r.get_frame_times().summary();
+        percentile_summary update = r.get_update_times().summary();
+        percentile_summary render = r.get_render_times().summary();
+        percentile_summary gpu = r.get_gpu_times().summary();
+        const render_stats &stats = r.get_stats();
+        float frame_p50 = frame.p50.as_seconds() * 1000.f;
+        int length = std::snprintf(
+            buffer.data(), buffer.size(),
+            "fps %.1f resolution scale %.2f\n"
+            "frame p50 %.2f p99 %.2f max %.2f ms\n"
+            "update %.2f render %.2f gpu %.2f ms p50\n"
+            "draws %llu instanced %llu instances %llu\n"
+            "primitives %llu\n"
+            "gpu buffers %.1f MB textures %.1f MB",
+            frame_p50 > 0.f ? 1000.f / frame_p50 : 0.f, r.get_resolution_scale(), frame_p50,
+            frame.p99.as_seconds() * 1000.f, frame.max.as_seconds() * 1000.f, update.p50.as_seconds() * 1000.f,
+            render.p50.as_seconds() * 1000.f, gpu.p50.as_seconds() * 1000.f,
+            static_cast<unsigned long long>(stats.draw_calls),
+            static_cast<unsigned long long>(stats.instanced_draw_calls),
+            static_cast<unsigned long long>(stats.instances), static_cast<unsigned long long>(stats.primitives),
+            gpu_memory.buffer_bytes.load() / 1048576.0, gpu_memory.texture_bytes.load() / 1048576.0);
+        // assigning within the reserved capacity does not allocate
+        text_buffer.assign(buffer.data(), std::clamp(length, 0, static_cast<int>(buffer.size()) - 1));
+    }
+    inline static constexpr size_t text_capacity = 512;
+    inline static constexpr int text_lines = 6;
+    inline static constexpr float margin = 0.03f;
+    inline static constexpr float line_height = 0.05f;
+    inline static constexpr float graph_width = 0.72f;
+    inline static constexpr float graph_height = 0.2f;
+    inline static constexpr float graph_max_ms = 1000.f / 30.f;
+    inline static const squint::quantities::time_f text_period{0.25f};
+    std::array<char, text_capacity> buffer{};
+    std::string text_buffer;
+    squint::quantities::time_f text_age{0.f};
+    std::array<float, graph_samples> frame_ms{};
+    size_t next_sample = 0;
+};
+// Toggles the HUD and keeps its projection in sync with the window without consuming the resize event, so other
+// cameras in the scene are resized too.
+template <typename T> class perf_hud_controller : public controls_system<T> {
+  public:
+    virtual bool on_key(const key_event &event, T &hud) const override final {
+        if (event == hud.get_toggle_key()) {
+            hud.set_visible(!hud.is_visible());
+            return true;
+        }
+        return false;
+    }
+    virtual bool on_resize(const window_resize_event &event, T &hud) const override final {
+        hud.resize(float(event.width) / float(event.height));
+        return false;
+    }
+};
+// An overlay showing frame rate, frame time percentiles and a frame time graph, draw call and instance counts of the
+// last frame, and the GPU memory allocated for buffers and textures.
+//
+// Attach the HUD as the last child of the object loaded by a renderer so it is drawn over the scene. Pressing toggle_key
+// shows or hides the HUD. Its camera is not part of the object tree so it never handles the window resize event in
+// place of the scene's cameras.
+class perf_hud : public entity<perf_hud> {
+  public:
+    perf_hud(float aspect, key_event toggle_key = key_event::F3_DOWN, bool visible = false)
+        : cam(std::make_unique<camera>(projection_type::ORTHOGRAPHIC, aspect)), toggle_key(toggle_key) {
+        mat = gen_object<basic_color>(cam.get());
+        mat->gen_object<perf_hud_display>(mat, cam.get());
+        attach_controls_system<perf_hud_controller>();
+        set_visible(visible);
+    }
+    inline void set_visible(bool visible) { mat->disabled = !visible; }
+    inline bool is_visible() const { return !mat->disabled; }
+    inline key_event get_toggle_key() const { return toggle_key; }
+    void resize(float aspect) {
+        cam->set_aspect(aspect);
+        cam->recalculate_projection();
+    }
+
+  private:
+    std::unique_ptr<camera> cam;
+    basic_color *mat;
+    key_event toggle_key;
+};
+} // namespace square
@@ -1,13 +1,29 @@
 module;
 #include <algorithm>
+#include <atomic>
 #include <memory>
+#include <stdexcept>
 #include <vector>
 #include <cassert>
 export module square:entity;
 import :system;
+import :profiler;
+import :task;
 import squint;
 
 export namespace square {
+// Set when something that affects how a scene looks has changed since renderers last checked. Renderers in on-demand
+// mode only render when it is set or they receive input.
+inline std::atomic<bool> scene_changed = false;
+// Tell on-demand renderers to render another frame. Transforms call this when they change and objects call it when
+// they are destroyed. Call it after changing anything else a frame depends on, like a material's color, the vertices of
+// a mesh, or the disabled flag of an object. Safe to call from any thread.
+inline void mark_scene_changed() {
+    // only write when the flag changes so objects updated in parallel don't contend for its cache line
+    if (!scene_changed.load(std::memory_order_relaxed)) {
+        scene_changed.store(true, std::memory_order_relaxed);
+    }
+}
 // Abstract base class for objects in a renderer.
 //
 // Objects can have any number of child objects and up to one parent object. Typically the renderer is the root
@@ -25,6 +41,10 @@ export namespace square {
 //
 // An object can be disabled. If the object is disabled, it will not be updated (no callbacks will be executed) until it
 // is enabled again. the enter() and load() callbacks will be called regard of disabled state
+//
+// update() can't be overridden, objects change over time with physics systems attached to entities. Renderers with
+// properties.parallel_systems collect the runs of the systems with collect_physics() instead of calling update(), so
+// an overridden update() would be skipped.
 class object {
   public:
     object();
@@ -43,7 +63,10 @@ class object {
         child_objects.push_back(std::move(obj));
         return obj_ptr;
     }
-    virtual void update(squint::quantities::time_f dt);
+    // run the physics systems of the object and then update the child objects
+    void update(squint::quantities::time_f dt);
+    // add the physics system runs of an update() to runs in the order update() would run them, without running them
+    virtual void collect_physics(squint::quantities::time_f dt, std::vector<physics_run> &runs);
     virtual void render(squint::quantities::time_f dt);
     virtual bool on_key(const key_event &event);
     virtual bool on_mouse_button(const mouse_button_event &event);
@@ -54,15 +77,22 @@ class object {
     bool disabled;
     void destroy();
     inline bool should_destroy() const { return destroy_flag; }
+    // Run a task with the active renderer's scheduler until it is done or the object is destroyed. The task isn't
+    // resumed while the object is disabled. Must be called where a renderer is active, e.g. from on_enter() or a
+    // physics system, and by one thread at a time for the same object.
+    void start_task(task t);
     // remove child objects marked for destruction recursively
     void prune();
 
   protected:
     virtual void on_enter() {}
     virtual void on_exit() {}
+    // run the physics systems of this object, called by update() before the child objects are updated
+    virtual void update_systems(squint::quantities::time_f dt) {}
 
   private:
     std::vector<std::unique_ptr<object>> child_objects{};
+    std::vector<task> tasks{};
     bool destroy_flag;
     bool destructible;
 };
@@ -75,17 +105,30 @@ class object {
 // to the entity must be templated so as to be compatible with the entity typically by using concepts.
 template <typename T> class entity : public object {
   public:
-    virtual void update(squint::quantities::time_f dt) override final {
+    virtual void collect_physics(squint::quantities::time_f dt, std::vector<physics_run> &runs) override final {
         if (!disabled) {
-            std::for_each(physics_systems.begin(), physics_systems.end(),
-                          [this, dt](auto &ps) { ps->update(dt, static_cast<T &>(*this)); });
-            object::update(dt);
+            for (auto &ps : physics_systems) {
+                size_t count = ps.schedule.advance(dt);
+                if (count > 0) {
+                    runs.push_back({ps.system->get_access(), ps.system.get(), static_cast<T *>(this), count,
+                                    ps.schedule.step(dt), [](const physics_run &r) {
+                                        auto system = static_cast<const physics_system<T> *>(r.system);
+                                        profile_zone zone(profile_name(*system));
+                                        for (size_t i = 0; i < r.runs; i++) {
+                                            system->update(r.step, *static_cast<T *>(r.entity));
+                                        }
+                                    }});
+                }
+            }
+            object::collect_physics(dt, runs);
         }
     }
     virtual void render(squint::quantities::time_f dt) override final {
         if (!disabled) {
-            std::for_each(render_systems.begin(), render_systems.end(),
-                          [this, dt](auto &rs) { rs->render(dt, static_cast<T &>(*this)); });
+            std::for_each(render_systems.begin(), render_systems.end(), [this, dt](auto &rs) {
+                profile_zone zone(profile_name(*rs));
+                rs->render(dt, static_cast<T &>(*this));
+            });
             object::render(dt);
         }
     }
@@ -151,18 +194,43 @@ template <typename T> class entity : public object {
         controls_systems.push_back(std::make_unique<U<T>>(args...));
     }
     template <template <class V> class U, typename... Args> void attach_physics_system(Args... args) {
-        physics_systems.push_back(std::make_unique<U<T>>(args...));
+        physics_systems.push_back({std::make_unique<U<T>>(args...), physics_schedule()});
+    }
+    // attach a physics system that runs rate times per second of simulated time, see physics_schedule
+    template <template <class V> class U, typename... Args>
+    void attach_physics_system_at_rate(float rate, Args... args) {
+        physics_systems.push_back({std::make_unique<U<T>>(args...), physics_schedule(rate)});
     }
     template <template <class V> class U, typename... Args> void attach_render_system(Args... args) {
         render_systems.push_back(std::make_unique<U<T>>(args...));
     }
 
+  protected:
+    virtual void update_systems(squint::quantities::time_f dt) override final {
+        std::for_each(physics_systems.begin(), physics_systems.end(), [this, dt](auto &ps) {
+            // systems with a low rate cost nothing in the updates they don't run in
+            size_t runs = ps.schedule.advance(dt);
+            if (runs == 0) {
+                return;
+            }
+            profile_zone zone(profile_name(*ps.system));
+            squint::quantities::time_f step = ps.schedule.step(dt);
+            for (size_t i = 0; i < runs; i++) {
+                ps.system->update(step, static_cast<T &>(*this));
+            }
+        });
+    }
+
   private:
     // destructor is private and T is a friend of entity<T>. This enforces use of CTRP for this class
     friend T;
     virtual ~entity() {}
     std::vector<std::unique_ptr<controls_system<T>>> controls_systems{};
-    std::vector<std::unique_ptr<physics_system<T>>> physics_systems{};
+    struct scheduled_physics_system {
+        std::unique_ptr<physics_system<T>> system;
+        physics_schedule schedule;
+    };
+    std::vector<scheduled_physics_system> physics_systems{};
     std::vector<std::unique_ptr<render_system<T>>> render_systems{};
 };
 
@@ -170,6 +238,17 @@ object::object() : disabled(false), destroy_flag(false), destructible(true) {}
 void object::destroy() {
     assert(destructible);
     destroy_flag = true;
+    mark_scene_changed();
+}
+void object::start_task(task t) {
+    task_scheduler *scheduler = task_scheduler::active();
+    if (!scheduler) {
+        throw std::runtime_error("Tasks can only be started on the thread of an active renderer");
+    }
+    // forget the tasks that are done so objects starting many short tasks don't accumulate them
+    std::erase_if(tasks, [](const task &t) { return t.done(); });
+    tasks.push_back(std::move(t));
+    scheduler->start(tasks.back(), &disabled);
 }
 void object::prune() {
     // first check if any children can be removed
@@ -196,9 +275,16 @@ void object::on_unload() {
 };
 void object::update(squint::quantities::time_f dt) {
     if (!disabled) {
+        update_systems(dt);
         std::for_each(child_objects.begin(), child_objects.end(), [dt](auto &obj) { obj->update(dt); });
     }
 }
+void object::collect_physics(squint::quantities::time_f dt, std::vector<physics_run> &runs) {
+    if (!disabled) {
+        std::for_each(child_objects.begin(), child_objects.end(),
+                      [dt, &runs](auto &obj) { obj->collect_physics(dt, runs); });
+    }
+}
 void object::render(squint::quantities::time_f dt) {
     if (!disabled) {
         std::for_each(child_objects.begin(), child_objects.end(), [dt](auto &obj) { obj->render(dt); });
@@ -0,0 +1,75 @@
+module;
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+export module square:frame_pacer;
+import :histogram;
+
+export namespace square {
+// Sleep until a time with sub-millisecond precision.
+//
+// The OS wakes sleeping threads late by an amount that depends on the scheduler, so the thread sleeps until a margin
+// before the time and spins for the rest. The margin adapts to how late sleeps have woken up on this thread, so
+// spinning stays short on systems with precise timers.
+void precise_sleep_until(std::chrono::steady_clock::time_point time) {
+    using namespace std::chrono;
+    constexpr nanoseconds min_margin = microseconds(100);
+    constexpr nanoseconds max_margin = milliseconds(4);
+    thread_local nanoseconds margin = milliseconds(1);
+    auto now = steady_clock::now();
+    while (time - now > margin) {
+        auto requested = time - now - margin;
+        std::this_thread::sleep_for(requested);
+        auto woke = steady_clock::now();
+        nanoseconds oversleep = duration_cast<nanoseconds>(woke - now - requested);
+        // grow quickly when a sleep is late and shrink slowly so a single precise sleep doesn't cause a missed deadline
+        margin = std::clamp(std::max(oversleep + oversleep / 2, margin - margin / 64), min_margin, max_margin);
+        now = woke;
+    }
+    while (steady_clock::now() < time) {
+        std::this_thread::yield();
+    }
+}
+// Schedules the frames of a renderer at a fixed rate.
+//
+// Each frame has a deadline one period after the previous one. A frame that starts more than a period late is not made
+// up for with a burst of frames, the schedule restarts from it instead. How late frames start compared to their
+// deadlines is recorded as the pacing jitter.
+class frame_pacer {
+  public:
+    using clock = std::chrono::steady_clock;
+    // frames_per_second <= 0 disables pacing
+    void set_frame_rate(float frames_per_second, size_t jitter_window = 600) {
+        period = frames_per_second > 0.f
+                     ? std::chrono::nanoseconds(static_cast<int64_t>(1e9 / static_cast<double>(frames_per_second)))
+                     : std::chrono::nanoseconds(0);
+        deadline = clock::time_point{};
+        jitter.resize(jitter_window);
+    }
+    inline bool is_enabled() const { return period.count() > 0; }
+    inline std::chrono::nanoseconds get_period() const { return period; }
+    // the time the next frame should start
+    inline clock::time_point next_deadline() const { return deadline; }
+    inline bool is_due(clock::time_point now) const { return !is_enabled() || now >= deadline; }
+    // record the start of a frame and schedule the next
+    void start_frame(clock::time_point now) {
+        if (!is_enabled()) {
+            return;
+        }
+        if (deadline == clock::time_point{} || now - deadline > period) {
+            deadline = now + period;
+            return;
+        }
+        jitter.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - deadline).count());
+        deadline += period;
+    }
+    // how late frames started compared to their deadlines
+    inline const rolling_histogram &get_jitter() const { return jitter; }
+
+  private:
+    std::chrono::nanoseconds period{0};
+    clock::time_point deadline{};
+    rolling_histogram jitter{};
+};
+} // namespace square
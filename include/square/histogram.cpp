@@ -0,0 +1,122 @@
+module;
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+export module square:histogram;
+import squint;
+
+export namespace square {
+// Percentiles of the samples in a rolling_histogram window
+struct percentile_summary {
+    size_t count = 0;
+    squint::quantities::time_f p50{};
+    squint::quantities::time_f p95{};
+    squint::quantities::time_f p99{};
+    squint::quantities::time_f max{};
+};
+// A histogram of the most recent durations recorded, used to track percentiles of frame times.
+//
+// Durations are counted in logarithmic buckets with 8 buckets per power of two so percentiles are reported with at
+// most 12.5% error, rounded up to the upper edge of their bucket. The maximum is exact. The last window samples are
+// kept in a ring and their buckets are decremented as they are overwritten, so the histogram always describes the
+// current window.
+//
+// Recording and reading are lock free. Only one thread may record at a time but any thread can read a summary while
+// samples are recorded, in which case the summary may include a sample that is being replaced.
+class rolling_histogram {
+  public:
+    explicit rolling_histogram(size_t window = 600) { resize(window); }
+    rolling_histogram(const rolling_histogram &) = delete;
+    rolling_histogram &operator=(const rolling_histogram &) = delete;
+    // change the number of samples in the window. Clears the histogram and must not be called while it is in use.
+    void resize(size_t window) {
+        window_size = std::max<size_t>(window, 1);
+        samples = std::make_unique<std::atomic<int64_t>[]>(window_size);
+        for (auto &bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        next.store(0, std::memory_order_relaxed);
+    }
+    void record(int64_t duration_ns) {
+        duration_ns = std::max<int64_t>(duration_ns, 0);
+        size_t i = next.load(std::memory_order_relaxed);
+        auto &sample = samples[i % window_size];
+        if (i >= window_size) {
+            buckets[bucket_index(sample.load(std::memory_order_relaxed))].fetch_sub(1, std::memory_order_relaxed);
+        }
+        sample.store(duration_ns, std::memory_order_relaxed);
+        buckets[bucket_index(duration_ns)].fetch_add(1, std::memory_order_relaxed);
+        next.store(i + 1, std::memory_order_release);
+    }
+    void record(squint::quantities::time_f duration) {
+        record(static_cast<int64_t>(static_cast<double>(duration.as_seconds()) * 1e9));
+    }
+    inline size_t window() const { return window_size; }
+    inline size_t count() const { return std::min(next.load(std::memory_order_acquire), window_size); }
+    percentile_summary summary() const {
+        percentile_summary result{};
+        result.count = count();
+        if (result.count == 0) {
+            return result;
+        }
+        std::array<uint32_t, bucket_count> counts{};
+        uint64_t total = 0;
+        for (size_t i = 0; i < bucket_count; i++) {
+            counts[i] = buckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        auto percentile = [&counts, total](double p) {
+            uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(p * static_cast<double>(total) + 0.5), 1);
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < bucket_count; i++) {
+                cumulative += counts[i];
+                if (cumulative >= rank) {
+                    return to_time(bucket_upper_edge(i));
+                }
+            }
+            return to_time(bucket_upper_edge(bucket_count - 1));
+        };
+        result.p50 = percentile(0.50);
+        result.p95 = percentile(0.95);
+        result.p99 = percentile(0.99);
+        int64_t max_ns = 0;
+        for (size_t i = 0; i < result.count; i++) {
+            max_ns = std::max(max_ns, samples[i].load(std::memory_order_relaxed));
+        }
+        result.max = to_time(max_ns);
+        return result;
+    }
+
+  private:
+    // 8 linear buckets for durations below 8ns then 8 buckets per power of two, up to 2^42ns (about 73 minutes).
+    // Longer durations are counted in the last bucket.
+    inline static constexpr size_t bucket_count = 320;
+    static size_t bucket_index(int64_t duration_ns) {
+        uint64_t value = static_cast<uint64_t>(duration_ns);
+        if (value < 8) {
+            return static_cast<size_t>(value);
+        }
+        int exponent = std::bit_width(value) - 1;
+        size_t sub_bucket = static_cast<size_t>((value >> (exponent - 3)) & 7);
+        return std::min(static_cast<size_t>(exponent - 2) * 8 + sub_bucket, bucket_count - 1);
+    }
+    static int64_t bucket_upper_edge(size_t index) {
+        if (index < 8) {
+            return static_cast<int64_t>(index);
+        }
+        int exponent = static_cast<int>(index / 8) + 2;
+        int64_t lower = static_cast<int64_t>(8 + index % 8) << (exponent - 3);
+        return lower + (int64_t{1} << (exponent - 3)) - 1;
+    }
+    static squint::quantities::time_f to_time(int64_t duration_ns) {
+        return squint::quantities::time_f{static_cast<float>(static_cast<double>(duration_ns) * 1e-9)};
+    }
+    size_t window_size = 1;
+    std::unique_ptr<std::atomic<int64_t>[]> samples;
+    std::array<std::atomic<uint32_t>, bucket_count> buckets{};
+    std::atomic<size_t> next = 0;
+};
+} // namespace square
@@ -0,0 +1,191 @@
+module;
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+export module square:profiler;
+
+export namespace square {
+// The profiler is compiled in by configuring with -DSQUARE_ENABLE_PROFILER=ON. When it is disabled, profile zones are
+// empty and are removed by the compiler.
+#ifdef SQUARE_ENABLE_PROFILER
+inline constexpr bool profiler_enabled = true;
+#else
+inline constexpr bool profiler_enabled = false;
+#endif
+// A completed profile zone
+struct profile_event {
+    const char *name;    // zone names must outlive the capture, e.g. string literals or typeid names
+    int64_t start_ns;    // nanoseconds since the profiler was created
+    int64_t duration_ns; // nanoseconds the zone was open
+};
+// Collects profile zones from all threads and exports them as Chrome trace JSON.
+//
+// Zones are only recorded between begin_capture() and end_capture(). Each thread records into its own buffer so
+// recording a zone only takes an uncontended lock. GPU zones are recorded into a separate track once their timer
+// results are available, usually a few frames after the work was submitted. The trace can be viewed with
+// chrome://tracing or https://ui.perfetto.dev
+class profiler {
+  public:
+    static profiler &instance() {
+        static profiler INSTANCE;
+        return INSTANCE;
+    }
+    // clear any recorded zones and start recording
+    void begin_capture() {
+        std::lock_guard lock(buffers_mutex);
+        for (auto &buffer : buffers) {
+            std::lock_guard buffer_lock(buffer->mutex);
+            buffer->events.clear();
+        }
+        capturing.store(true, std::memory_order_relaxed);
+    }
+    // stop recording and write the recorded zones to a Chrome trace JSON file
+    void end_capture(const std::filesystem::path &trace_filepath) {
+        capturing.store(false, std::memory_order_relaxed);
+        write_chrome_trace(trace_filepath);
+    }
+    inline bool is_capturing() const { return capturing.load(std::memory_order_relaxed); }
+    // record a zone that ran on the calling thread
+    void record(const char *name, int64_t start_ns, int64_t duration_ns) {
+        if (is_capturing()) {
+            thread_buffer &buffer = local_buffer();
+            std::lock_guard lock(buffer.mutex);
+            buffer.events.push_back({name, start_ns, duration_ns});
+        }
+    }
+    // record a zone that ran on the GPU. start_ns is the time the work was submitted.
+    void record_gpu(const char *name, int64_t start_ns, int64_t duration_ns) {
+        if (is_capturing()) {
+            std::lock_guard lock(gpu_buffer->mutex);
+            gpu_buffer->events.push_back({name, start_ns, duration_ns});
+        }
+    }
+    // nanoseconds since the profiler was created
+    int64_t now_ns() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+  private:
+    struct thread_buffer {
+        std::mutex mutex;
+        uint32_t thread_id = 0;
+        std::vector<profile_event> events;
+    };
+    profiler() : gpu_buffer(std::make_shared<thread_buffer>()) {}
+    thread_buffer &local_buffer() {
+        // buffers are owned by the profiler so the zones of threads that have exited are still exported
+        thread_local std::shared_ptr<thread_buffer> buffer;
+        if (!buffer) {
+            buffer = std::make_shared<thread_buffer>();
+            std::lock_guard lock(buffers_mutex);
+            buffer->thread_id = static_cast<uint32_t>(buffers.size() + 1);
+            buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+    // zone names may be mangled type names
+    static std::string demangle(const char *name) {
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+        if (status != 0 || demangled == nullptr) {
+            return name;
+        }
+        std::string result(demangled);
+        std::free(demangled);
+        return result;
+    }
+    static std::string escape(const std::string &name) {
+        std::string result{};
+        for (char c : name) {
+            if (c == '"' || c == '\\') {
+                result.push_back('\\');
+            }
+            result.push_back(c);
+        }
+        return result;
+    }
+    void write_chrome_trace(const std::filesystem::path &trace_filepath) {
+        std::ofstream file(trace_filepath);
+        if (!file) {
+            throw std::runtime_error("Could not write trace " + trace_filepath.string());
+        }
+        std::unordered_map<const char *, std::string> names{};
+        auto event_name = [&names](const char *name) -> const std::string & {
+            auto it = names.find(name);
+            if (it == names.end()) {
+                it = names.emplace(name, escape(demangle(name))).first;
+            }
+            return it->second;
+        };
+        bool first = true;
+        auto write_events = [&](thread_buffer &buffer, const std::string &track_name) {
+            std::lock_guard lock(buffer.mutex);
+            file << (first ? "\n" : ",\n") << R"({"name":"thread_name","ph":"M","pid":0,"tid":)" << buffer.thread_id
+                 << R"(,"args":{"name":")" << track_name << R"("}})";
+            first = false;
+            for (const auto &event : buffer.events) {
+                file << ",\n"
+                     << R"({"name":")" << event_name(event.name) << R"(","ph":"X","pid":0,"tid":)" << buffer.thread_id
+                     << R"(,"ts":)" << event.start_ns / 1000.0 << R"(,"dur":)" << event.duration_ns / 1000.0 << "}";
+            }
+            buffer.events.clear();
+        };
+        file << std::fixed << std::setprecision(3) << R"({"traceEvents":[)";
+        write_events(*gpu_buffer, "GPU");
+        std::lock_guard lock(buffers_mutex);
+        for (auto &buffer : buffers) {
+            write_events(*buffer, "thread " + std::to_string(buffer->thread_id));
+        }
+        file << "\n]}\n";
+    }
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::atomic<bool> capturing = false;
+    std::mutex buffers_mutex;
+    std::vector<std::shared_ptr<thread_buffer>> buffers;
+    std::shared_ptr<thread_buffer> gpu_buffer; // thread_id 0 is the GPU track
+};
+// Times the scope it is declared in on the CPU.
+//
+// Zones can be nested and are shown nested in the trace. The name is not copied and must outlive the capture.
+class profile_zone {
+  public:
+    explicit profile_zone(const char *name) {
+        if constexpr (profiler_enabled) {
+            this->name = name;
+            start_ns = profiler::instance().now_ns();
+        }
+    }
+    profile_zone(const profile_zone &) = delete;
+    profile_zone &operator=(const profile_zone &) = delete;
+    ~profile_zone() {
+        if constexpr (profiler_enabled) {
+            profiler &p = profiler::instance();
+            p.record(name, start_ns, p.now_ns() - start_ns);
+        }
+    }
+
+  private:
+    const char *name = nullptr;
+    int64_t start_ns = 0;
+};
+// The name of the dynamic type of an object for a profile zone. The type isn't looked up when the profiler is disabled.
+template <typename T> const char *profile_name(const T &object) {
+    if constexpr (profiler_enabled) {
+        return typeid(object).name();
+    } else {
+        return nullptr;
+    }
+}
+} // namespace square
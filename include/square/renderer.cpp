@@ -1,12 +1,29 @@
 module;
+#include <algorithm>
 #include <cstring>
 #include <filesystem>
 #include <memory>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 export module square:renderer;
 import :transform;
 import :entity;
 import :system;
+import :thread_pool;
+import :profiler;
+import :histogram;
+import :dynamic_resolution;
+import :frame_pacer;
+import :task;
+import :system_scheduler;
 import squint;
 
 export namespace square {
@@ -85,6 +102,26 @@ enum class draw_method {
                       the previous vertex, and the first vertex in the vertex
                       buffer. */
 };
+// number of points, lines, or triangles assembled from vertex_count vertices
+constexpr uint64_t primitive_count(draw_method method, uint64_t vertex_count) {
+    switch (method) {
+    case draw_method::POINTS:
+        return vertex_count;
+    case draw_method::LINES:
+        return vertex_count / 2;
+    case draw_method::LINE_STRIP:
+        return vertex_count > 1 ? vertex_count - 1 : 0;
+    case draw_method::LINE_LOOP:
+        return vertex_count > 1 ? vertex_count : 0;
+    case draw_method::TRIANGLES:
+        return vertex_count / 3;
+    case draw_method::TRIANGLE_STRIP:
+    case draw_method::TRIANGLE_FAN:
+        return vertex_count > 2 ? vertex_count - 2 : 0;
+    default:
+        return 0;
+    }
+}
 enum class index_type {
     NONE,           // signals no index buffer exists on this mesh
     UNSIGNED_BYTE,  // 1 byte indices
@@ -108,6 +145,44 @@ enum class texture_type {
                 point numbers. And used to create textures of the depth values from a
                 framebuffer.*/
 };
+enum class texture_filter {
+    NEAREST,   /**< Textures are sampled from the nearest texel of the nearest mip level.*/
+    LINEAR,    /**< Textures are sampled with bilinear filtering from the nearest mip level.*/
+    TRILINEAR, /**< Textures are sampled with bilinear filtering from the two nearest mip levels and blended
+                  between them. This is the default.*/
+};
+enum class texture_wrap {
+    REPEAT,          /**< Texture coordinates outside of [0,1] repeat the texture. This is the default.*/
+    MIRRORED_REPEAT, /**< Texture coordinates outside of [0,1] repeat the texture mirrored every other repeat.*/
+    CLAMP_TO_EDGE,   /**< Texture coordinates are clamped to [0,1].*/
+};
+// settings used to sample a texture. Samplers are shared by all textures with the same settings.
+struct sampler_settings {
+    texture_filter filter = texture_filter::TRILINEAR;
+    texture_wrap wrap = texture_wrap::REPEAT;
+    float anisotropy = 1.f; // maximum anisotropy, clamped to what the hardware supports. 1 disables it.
+    bool operator==(const sampler_settings &) const = default;
+};
+enum class texture_packing {
+    LAYERS, /**< Each image is one layer of the texture array. All images must have the same size.*/
+    ATLAS,  /**< Images are rectangle packed into atlas pages and each page is one layer of the texture array. Images
+               can have different sizes.*/
+};
+// The region of a texture array an image was packed into.
+//
+// The layout matches a std430 storage buffer element 'struct texture_region { vec4 uv_rect; uint layer; };' so regions
+// can be written directly into per-instance storage buffers.
+struct texture_region {
+    squint::fvec4 uv_rect{}; // offset (x, y) and size (z, w) of the image in texture coordinates of its layer
+    uint32_t layer = 0;
+    uint32_t padding[3]{};
+};
+// Pixels read back from a renderer, RGBA with 8 bits per channel and rows ordered from top to bottom
+struct framebuffer_image {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels{};
+};
 enum class shader_type {
     VERTEX_SHADER,
     TESS_CONTROL_SHADER,
@@ -237,6 +312,40 @@ class buffer_format {
                   the buffer. The total size of all the buffer attributes.*/
 };
 
+// Counters of the work a renderer submitted during one frame.
+//
+// The same struct is used as a budget, where a counter of zero means the counter has no budget.
+struct render_stats {
+    uint64_t draw_calls = 0;             // draws of simple meshes
+    uint64_t instanced_draw_calls = 0;   // draws of instanced meshes
+    uint64_t instances = 0;              // instances drawn by instanced draws
+    uint64_t primitives = 0;             // points, lines, and triangles submitted, including every instance
+    uint64_t program_binds = 0;          // shaders activated
+    uint64_t vertex_array_binds = 0;     // vertex input assemblies activated
+    uint64_t texture_binds = 0;          // textures uploaded to shaders
+    uint64_t storage_buffer_binds = 0;   // storage buffers uploaded to shaders
+    uint64_t uniform_uploads = 0;        // matrices and vectors uploaded to shaders
+    uint64_t buffer_bytes_written = 0;   // bytes written into buffers when they are created or with write_elements()
+    uint64_t texture_bytes_uploaded = 0; // bytes of image data uploaded to textures
+    // true if any counter with a nonzero budget exceeds it
+    bool exceeds(const render_stats &budget) const {
+        auto over = [](uint64_t value, uint64_t limit) { return limit != 0 && value > limit; };
+        return over(draw_calls, budget.draw_calls) || over(instanced_draw_calls, budget.instanced_draw_calls) ||
+               over(instances, budget.instances) || over(primitives, budget.primitives) ||
+               over(program_binds, budget.program_binds) || over(vertex_array_binds, budget.vertex_array_binds) ||
+               over(texture_binds, budget.texture_binds) || over(storage_buffer_binds, budget.storage_buffer_binds) ||
+               over(uniform_uploads, budget.uniform_uploads) ||
+               over(buffer_bytes_written, budget.buffer_bytes_written) ||
+               over(texture_bytes_uploaded, budget.texture_bytes_uploaded);
+    }
+};
+// Bytes of GPU memory currently allocated for buffers and textures by all renderers. Texture sizes include their mip
+// chains. Memory the driver allocates internally is not counted.
+struct gpu_memory_counters {
+    std::atomic<int64_t> buffer_bytes = 0;
+    std::atomic<int64_t> texture_bytes = 0;
+};
+inline gpu_memory_counters gpu_memory{};
 // These properties can be set when constructing a renderer
 struct renderer_properties {
     const char *window_title = "untitled";
@@ -246,9 +355,55 @@ struct renderer_properties {
     bool wireframe = false;
     bool fullscreen = false;
     bool vsync = false;
+    // When vsync is off, frames are started at most max_frame_rate times per second, or at the display's refresh rate
+    // if limit_to_display_rate is set. 0 starts frames as fast as possible.
+    float max_frame_rate = 0.f;
+    bool limit_to_display_rate = false;
+    // Only render a frame when the renderer receives input, its window is exposed or resized, the scene changed (see
+    // mark_scene_changed()), or request_redraw() is called. Otherwise the renderer waits for events without rendering.
+    bool on_demand = false;
+    // Run the renderer's frames on a thread of its own with its context current on that thread, so renderers don't
+    // wait for each other's buffer swaps. The main thread still receives the events and hands them to the renderer.
+    bool threaded = false;
+    // Renderers with the same resource group share their GPU resources, e.g. the programs, buffers and textures of a
+    // backend whose contexts can share objects, and the resources stored with renderer::shared_resource(). nullptr
+    // keeps the resources to the renderer.
+    const char *resource_group = nullptr;
+    bool hidden = false;   // create the window hidden, e.g. for benchmarks that don't need to be seen
+    bool headless = false; // render offscreen into a framebuffer of window_width by window_height, never shown
     cursor_type cursor = cursor_type::ENABLED;
+    // deliver the mouse motion of a frame as one on_mouse_move() event with the last position and the summed relative
+    // motion, so high rate mice don't dispatch an event through the object tree for every report
+    bool coalesce_mouse_motion = false;
+    // Frames the GPU may still be rendering when the CPU starts the next frame. Waiting for the GPU keeps the driver
+    // from queueing frames, which shortens the time from input to the frame showing it. 0 lets the driver decide, or
+    // allows 1 frame for headless renderers.
+    int max_frames_in_flight = 0;
+    // handle the events that arrived during update() right before render(), so rendering reflects the latest input
+    // Ignored with pipelined_update, whose update() runs while the next events are handled.
+    bool late_input_sampling = false;
+    // Run update() on a job of app::jobs() while the previous update is rendered, so a frame takes as long as the
+    // longer of the two instead of their sum. update() must not call the rendering API, and state it changes that
+    // render() reads must be kept in double_buffered values. Events are handled between updates.
+    bool pipelined_update = false;
+    // Run the physics systems of an update on app::jobs() as well as the updating thread, in parallel where the access
+    // the systems declare allows it, see system_access. Systems that don't declare their access run alone, in order.
+    // The runs of the systems are collected before any of them runs, so systems must not attach, destroy, enable or
+    // disable objects.
+    bool parallel_systems = false;
     debug_mode debug = debug_mode::NOTIFICATION;
     squint::quantities::time_f fixed_dt{1.f / 60.f};
+    size_t texture_upload_budget = 16 << 20; // bytes of asynchronously loaded texture data uploaded per frame
+    int texture_atlas_size = 2048;           // width and height in texels of the pages of packed texture atlases
+    size_t frame_time_window = 600;          // number of frames the frame time percentiles are computed over
+    bool print_frame_times = false;          // print the frame time percentiles when the renderer is destroyed
+    // Render the loaded object at a lower resolution when the GPU time per frame exceeds target_gpu_time, scaling each
+    // dimension of the window by a factor between min_resolution_scale and max_resolution_scale, then upscale it to
+    // the window. Multisampling is applied to the scaled image.
+    bool dynamic_resolution = false;
+    float min_resolution_scale = 0.5f;
+    float max_resolution_scale = 1.f;
+    squint::quantities::time_f target_gpu_time{1.f / 60.f};
 };
 // forward declaring these so we can work with them in the renderer and app classes
 class app;
@@ -257,9 +412,48 @@ class buffer;
 class mesh;
 class vertex_input_assembly;
 class texture2D;
+class texture2D_array;
+class render_target;
 class simple_mesh;
 class instanced_mesh;
 class material;
+// Resources shared by the renderers of a group, see renderer_properties::resource_group.
+//
+// Resources are created by the first renderer that asks for them and live until the last renderer of the group is
+// detached, while its context is still active. Backends store their shared objects here too.
+class resource_group {
+  public:
+    // the group with the name, created when its first renderer joins. Renderers without a name get a group of their
+    // own.
+    static std::shared_ptr<resource_group> join(const char *name) {
+        if (!name || !*name) {
+            return std::make_shared<resource_group>();
+        }
+        static std::mutex groups_mutex;
+        static std::unordered_map<std::string, std::weak_ptr<resource_group>> groups;
+        std::lock_guard lock(groups_mutex);
+        auto &weak_group = groups[name];
+        auto group = weak_group.lock();
+        if (!group) {
+            group = std::make_shared<resource_group>();
+            weak_group = group;
+        }
+        return group;
+    }
+    // get the resource stored under the key, creating it with create() if the group doesn't have it yet
+    template <typename T, typename F> std::shared_ptr<T> get_or_create(const std::string &key, F &&create) {
+        std::lock_guard lock(mutex);
+        auto &resource = resources[key];
+        if (!resource) {
+            resource = std::shared_ptr<T>(create());
+        }
+        return std::static_pointer_cast<T>(resource);
+    }
+
+  private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<void>> resources;
+};
 // This is an abstract base class for renderers that is implemented by rendering APIs.
 //
 // A renderer acts as the root object in an application. Loading an object in a renderer sets the active scene
@@ -276,10 +470,15 @@ class renderer : public object {
     virtual void enable_face_culling(bool enable) = 0;
     virtual void enable_depth_testing(bool enable) = 0;
     virtual void enable_blending(bool enable) = 0;
+    // Shaders are deduplicated by the contents of their sources and defines, the name is only used as a debug label.
+    // Each define is inserted as '#define <define>' after the '#version' directive of every source.
+    // Shaders generated from identical sources share one program which is freed once no shader references it.
     virtual std::unique_ptr<shader> gen_shader(const std::string &name,
-                                               const std::filesystem::path &shader_src_directory) = 0;
+                                               const std::filesystem::path &shader_src_directory,
+                                               const std::vector<std::string> &defines = {}) = 0;
     virtual std::unique_ptr<shader> gen_shader(const std::string &name,
-                                               const std::vector<shader_src> &shader_sources) = 0;
+                                               const std::vector<shader_src> &shader_sources,
+                                               const std::vector<std::string> &defines = {}) = 0;
     inline const renderer_properties &get_properties() const { return properties; }
     template <typename T>
     std::unique_ptr<buffer> gen_buffer(const std::vector<T> &data, const buffer_format &format,
@@ -289,32 +488,153 @@ class renderer : public object {
     virtual std::unique_ptr<buffer> gen_buffer(const void *data, const size_t size_in_bytes,
                                                const buffer_format &format, const buffer_access_type type) = 0;
     virtual std::unique_ptr<texture2D> gen_texture(const std::filesystem::path &image_filepath) = 0;
+    // Load a texture without blocking. The image is decoded on a worker thread and uploaded at the start of a later
+    // frame, until then the texture samples a placeholder. Textures are shared by everything that loads the same path.
+    // If the image can't be decoded the texture keeps its placeholder and has_failed() becomes true, and loading the
+    // path again tries again.
+    virtual std::shared_ptr<texture2D> load_texture(const std::filesystem::path &image_filepath) = 0;
+    // Pack images of the same format into one texture array. The region of each image is returned by
+    // texture2D_array::get_region() in the order the paths were given. Throws if the images cannot be packed.
+    virtual std::unique_ptr<texture2D_array>
+    gen_texture_array(const std::vector<std::filesystem::path> &image_filepaths,
+                      texture_packing packing = texture_packing::LAYERS) = 0;
     virtual std::unique_ptr<vertex_input_assembly> gen_vertex_input_assembly(index_type type) = 0;
     virtual void draw_mesh(const simple_mesh *m, const transform *model, material *mat) = 0;
     virtual void draw_mesh(const instanced_mesh *m, const transform *model, material *mat,
                            unsigned int instance_count) = 0;
     virtual void set_viewport(size_t x, size_t y, size_t width, size_t height) = 0;
     virtual void set_cursor(cursor_type type) = 0;
+    // Create an offscreen framebuffer with a color and optionally a depth attachment. Targets with samples > 1 are
+    // multisampled.
+    virtual std::unique_ptr<render_target> gen_render_target(uint32_t width, uint32_t height, int samples = 1,
+                                                             bool depth = true) = 0;
+    // Draw into the target, or into the frame being rendered if target is nullptr, and set the viewport to cover it.
+    virtual void bind_render_target(render_target *target) = 0;
+    // Copy the region of the target from its origin to width by height to the frame being rendered, scaled to cover
+    // the whole frame. Multisampled targets are resolved first.
+    virtual void present_render_target(render_target *target, uint32_t width, uint32_t height,
+                                       texture_filter filter = texture_filter::LINEAR) = 0;
+    // Read back the color buffer of the last frame, waiting until it is rendered. Only headless renderers keep the
+    // last frame, the contents of a window are undefined once its buffers are swapped.
+    virtual framebuffer_image read_framebuffer() = 0;
+    // time the GPU work submitted between these calls. Used by gpu_profile_zone. Renderers without GPU timers ignore
+    // these calls.
+    virtual void begin_gpu_zone(const char *name) {}
+    virtual void end_gpu_zone() {}
+    // counters of the last completed frame
+    inline const render_stats &get_stats() const { return last_frame_stats; }
+    // counters of the frame being rendered. Backends add to these as work is submitted.
+    inline render_stats &get_frame_stats() { return frame_stats; }
+    // warn when a frame exceeds the budget. Counters left at zero are not checked.
+    inline void set_stats_budget(const render_stats &budget) { stats_budget = budget; }
+    inline bool over_budget() const { return last_frame_stats.exceeds(stats_budget); }
+    // time between the start of consecutive frames, over the last properties.frame_time_window frames
+    inline const rolling_histogram &get_frame_times() const { return frame_times; }
+    // time spent in update() over the last properties.frame_time_window frames
+    inline const rolling_histogram &get_update_times() const { return update_times; }
+    // time spent in render() over the last properties.frame_time_window frames
+    inline const rolling_histogram &get_render_times() const { return render_times; }
+    // GPU time of the render() calls over the last properties.frame_time_window frames, for renderers with GPU timers.
+    // Measurements arrive a few frames after the frame was rendered.
+    inline const rolling_histogram &get_gpu_times() const { return gpu_times; }
+    // time from the arrival of the first input event of a frame to the end of the frame's swap, over the last
+    // properties.frame_time_window frames with input
+    inline const rolling_histogram &get_input_latencies() const { return input_latencies; }
+    // how late frames started compared to the schedule of properties.max_frame_rate
+    inline const rolling_histogram &get_pacing_jitter() const { return pacer.get_jitter(); }
+    // scale of each dimension of the window the loaded object is rendered at, 1 unless dynamic resolution is enabled
+    inline float get_resolution_scale() const { return properties.dynamic_resolution ? resolution.get_scale() : 1.f; }
+    void print_frame_times(std::ostream &os) const;
+    // Get the resource shared by the renderer's resource group under the key, creating it with create() the first time
+    // it is asked for, e.g. a texture used by every window. create() returns a pointer to a new T.
+    template <typename T, typename F> std::shared_ptr<T> shared_resource(const std::string &key, F &&create) {
+        return resources->get_or_create<T>(key, std::forward<F>(create));
+    }
+    // the keys and mouse buttons held down and the mouse motion of the current frame
+    inline const input_state &get_input() const { return input; }
+    // render another frame in on-demand mode, safe to call from any thread
+    inline void request_redraw() { redraw_requested = true; }
+    // false while the window is hidden or minimized, renderers don't render until it is shown again
+    inline bool is_visible() const { return visible; }
+    // number of completed updates whose state has been handed to render(), see double_buffered
+    inline uint64_t get_published_frame() const { return published_frame; }
+    // runs the tasks started by the renderer's objects, after the events of each frame are handled
+    inline task_scheduler &get_scheduler() { return scheduler; }
     virtual ~renderer(){};
 
   private:
-    void run_step();
+    // returns false if no frame was rendered
+    bool run_step();
+    // run update() and publish its state, on a job if properties.pipelined_update is set
+    void run_update();
+    // wait for the update started by the previous frame, rethrowing its exceptions
+    void finish_update();
     object *active_object = nullptr;
+    input_state input{};
+    task_scheduler scheduler{};
+    system_scheduler systems{};
+    std::vector<physics_run> physics_runs{};
+    std::atomic<bool> redraw_requested = true;
+    bool visible = true;
+    // Incremented by the renderer that consumes scene_changed so every renderer sees the change. Renderers redraw when
+    // it differs from the generation they last rendered.
+    inline static std::atomic<uint64_t> scene_generation = 0;
+    uint64_t rendered_generation = 0;
+    // the thread running the renderer's frames if properties.threaded is set, finished once the renderer is destroyed
+    std::thread render_thread;
+    std::atomic<bool> thread_finished = false;
+    uint64_t published_frame = 0;
+    std::future<int64_t> pending_update; // the duration of the update in nanoseconds
+    render_stats frame_stats{};
+    render_stats last_frame_stats{};
+    render_stats stats_budget{};
+    bool was_over_budget = false;
+    // sized from the properties when the renderer is attached
+    void init_frame_times();
+    rolling_histogram frame_times{};
+    rolling_histogram update_times{};
+    rolling_histogram render_times{};
+    rolling_histogram gpu_times{};
+    rolling_histogram input_latencies{};
+    std::chrono::steady_clock::time_point first_input_arrival{}; // of the frame being rendered, or zero without input
+    dynamic_resolution_controller resolution{};
+    frame_pacer pacer{};
+    std::chrono::steady_clock::time_point last_frame_start{};
 
   protected:
     // create the context. This will be final in renderer impl
     virtual void create_context() = 0;
+    // called at the start of each frame once the context is active
+    virtual void begin_frame() {}
+    // called before and after the loaded object is rendered
+    virtual void begin_render() {}
+    virtual void end_render() {}
+    // called by backends when the GPU time of a frame is measured
+    void record_gpu_time(int64_t duration_ns);
+    // called by backends for each input event with the time the event arrived, before it is dispatched
+    void record_input_arrival(std::chrono::steady_clock::time_point arrival);
     // see what input events have happened
     virtual void poll_events() = 0;
-    // cleanup the context
+    // Block until an event for this renderer arrives or timeout passes. Events are left for poll_events(). Called by
+    // renderers running on their own threads when they have no frame to render.
+    virtual void wait_events(std::chrono::milliseconds timeout) { std::this_thread::sleep_for(timeout); }
+    // Called by the app on the main thread once per loop. Wait until an event arrives or timeout passes, then hand the
+    // events to the renderers of the backend they belong to, to be handled in their poll_events().
+    virtual void pump_events(std::chrono::milliseconds timeout) {}
+    // called by backends when the window is shown, hidden, minimized or restored
+    void set_visible(bool is_visible);
+    // cleanup the context. Backends release resources before destroying the context, which deletes the group's
+    // resources if this is the last renderer of the group.
     virtual void destroy_context() = 0;
     // set this as the current context
     virtual void activate_context() = 0;
+    // make no context current on this thread so the context can be made current on another thread
+    virtual void release_context() = 0;
     // swap front and back buffers for use in double buffer rendering
     virtual void swap_buffers() = 0;
 
     // event, render, and physics callbacks
-    virtual void update(squint::quantities::time_f dt) override final;
+    void update(squint::quantities::time_f dt);
     virtual void render(squint::quantities::time_f dt) override final;
     virtual bool on_key(const key_event &event) override final;
     virtual bool on_mouse_button(const mouse_button_event &event) override final;
@@ -325,6 +645,8 @@ class renderer : public object {
     // load the root object (most likely a scene)
     void load_object(object *obj);
     renderer_properties properties{};
+    // the resource group joined when the renderer is attached, before its context is created
+    std::shared_ptr<resource_group> resources;
 };
 // An application containing one or more renderers.
 //
@@ -332,9 +654,17 @@ class renderer : public object {
 // renderers can be attached at a time and can be of different rendering APIs.
 class app {
   private:
-    app() : active_renderer_ptr(nullptr) {}
+    app() {}
     std::vector<std::unique_ptr<renderer>> renderers{};
-    renderer *active_renderer_ptr;
+    // each thread has its own active renderer so renderers running on their own threads don't see each other
+    inline static thread_local square::renderer *active_renderer_ptr = nullptr;
+    std::unique_ptr<square::thread_pool> job_pool;
+    std::once_flag job_pool_created;
+    // the renderer's task scheduler becomes active with it so objects can start tasks
+    static void set_active_renderer(square::renderer *r) {
+        active_renderer_ptr = r;
+        task_scheduler::set_active(r ? &r->scheduler : nullptr);
+    }
 
   public:
     // this is a singleton class so it should never be copied or moved
@@ -346,46 +676,202 @@ class app {
         static app INSTANCE;
         return INSTANCE;
     }
-    // get the active renderer. This is used by entities inside a renderer so that they can run commands from the
-    // renderer they are being rendered with
-    static renderer *renderer() { return instance().active_renderer_ptr; }
+    // get the active renderer of this thread. This is used by entities inside a renderer so that they can run commands
+    // from the renderer they are being rendered with
+    static renderer *renderer() { return active_renderer_ptr; }
+    // Make a renderer and a task scheduler active on the calling thread until the end of the scope, then restore the
+    // ones that were active before, also when the scope is left by an exception. Used by jobs running code of a
+    // renderer on worker threads, e.g. pipelined updates, so the code sees the renderer it runs for.
+    class scoped_active_renderer {
+      public:
+        scoped_active_renderer(square::renderer *r, task_scheduler *scheduler)
+            : previous(active_renderer_ptr), previous_scheduler(task_scheduler::active()) {
+            active_renderer_ptr = r;
+            task_scheduler::set_active(scheduler);
+        }
+        // make the renderer active with its own task scheduler
+        scoped_active_renderer(square::renderer *r) : scoped_active_renderer(r, r ? &r->scheduler : nullptr) {}
+        scoped_active_renderer(const scoped_active_renderer &) = delete;
+        scoped_active_renderer &operator=(const scoped_active_renderer &) = delete;
+        ~scoped_active_renderer() {
+            active_renderer_ptr = previous;
+            task_scheduler::set_active(previous_scheduler);
+        }
+
+      private:
+        square::renderer *previous;
+        task_scheduler *previous_scheduler;
+    };
     static const std::vector<std::unique_ptr<square::renderer>> &get_renderers() { return instance().renderers; }
+    // worker threads shared by the app for background jobs such as decoding assets. Created on first use.
+    static square::thread_pool &jobs() {
+        // renderers running on their own threads may use the pool first at the same time
+        std::call_once(instance().job_pool_created,
+                       []() { instance().job_pool = std::make_unique<square::thread_pool>(); });
+        return *instance().job_pool;
+    }
+    // Create a renderer and its context on the calling thread, which must be the main thread. Renderers with
+    // properties.threaded start running their frames on their own thread once on_enter() returns.
     template <typename U, typename... Args> static void attach_renderer(Args... args) {
         auto r = std::make_unique<U>(args...);
-        instance().active_renderer_ptr = r.get();
+        set_active_renderer(r.get());
+        r->resources = resource_group::join(r->properties.resource_group);
         r->create_context();
+        r->init_frame_times();
         r->on_enter(); // calling on_enter() instead of on_load() since we only want one child loaded at a time
+        set_active_renderer(nullptr);
+        if (r->properties.threaded) {
+            r->release_context();
+            r->render_thread = std::thread(run_thread, r.get());
+        }
         instance().renderers.push_back(std::move(r));
-        instance().active_renderer_ptr = nullptr;
     }
     // main program loop. This will loop as long as there are renderers attached.
     // renderers are automatically detached if an exit signal is sent from a renderer
     static void run() {
-        while (instance().renderers.size()) {
-            int i = 0;
-            bool renderer_exit = false;
-            for (auto &r : instance().renderers) {
-                if (!r->should_destroy()) {
-                    instance().active_renderer_ptr = r.get();
-                    r->run_step();
-                    instance().active_renderer_ptr = nullptr;
+        while (!instance().renderers.empty()) {
+            step();
+        }
+    }
+    // Run frame_count frames and return the number of frames run, which is less than frame_count if every renderer
+    // was detached. A frame is counted when any renderer on the main thread renders, renderers limited to a lower
+    // frame rate render fewer frames and renderers running on their own threads are not counted. Renderers stay
+    // attached after the last frame so their output can be inspected, destroy them and call run() to detach them.
+    static size_t run_frames(size_t frame_count) {
+        size_t frames = 0;
+        while (frames < frame_count && !instance().renderers.empty()) {
+            if (step()) {
+                frames++;
+            }
+        }
+        return frames;
+    }
+
+  private:
+    // longest time to wait for events while every renderer is idle, bounds how late changes made without an event,
+    // e.g. mark_scene_changed() from another thread, are rendered
+    inline static constexpr std::chrono::milliseconds max_idle_wait{100};
+    // Run a frame of every renderer on the main thread whose frame is due, then detach the renderers that sent an exit
+    // signal. If no renderer rendered, wait until the earliest frame is due or, if a renderer is idle or every renderer
+    // runs on its own thread, for an event. Returns true if any renderer rendered.
+    static bool step() {
+        auto &renderers = instance().renderers;
+        if (!renderers.empty()) {
+            profile_zone zone("pump_events");
+            renderers.front()->pump_events(std::chrono::milliseconds(0));
+        }
+        bool rendered = false;
+        bool idle = false;
+        auto earliest_deadline = frame_pacer::clock::time_point::max();
+        for (auto &r : renderers) {
+            if (!r->properties.threaded && !r->should_destroy()) {
+                auto now = frame_pacer::clock::now();
+                if (r->pacer.is_due(now)) {
+                    set_active_renderer(r.get());
+                    if (r->run_step()) {
+                        r->pacer.start_frame(now);
+                        rendered = true;
+                    } else {
+                        idle = true;
+                    }
+                    set_active_renderer(nullptr);
                 } else {
-                    renderer_exit = true;
-                    break;
+                    earliest_deadline = std::min(earliest_deadline, r->pacer.next_deadline());
                 }
+            }
+        }
+        for (size_t i = 0; i < renderers.size();) {
+            if (is_finished(*renderers[i])) {
+                detach_renderer(i);
+            } else {
                 i++;
             }
-            if (renderer_exit) {
-                auto r = std::move(instance().renderers[i]);
-                instance().active_renderer_ptr = r.get();
-                r->load_object(nullptr); // unload active object
-                r->on_exit();
-                r->destroy_context();
-                instance().renderers.erase(instance().renderers.begin() + i);
-                instance().active_renderer_ptr = nullptr;
+        }
+        if (renderers.empty()) {
+            return rendered;
+        }
+        bool main_thread_idle = std::all_of(renderers.begin(), renderers.end(),
+                                            [](const auto &r) { return r->properties.threaded; });
+        if (!rendered && (idle || main_thread_idle)) {
+            auto timeout = max_idle_wait;
+            if (earliest_deadline != frame_pacer::clock::time_point::max()) {
+                auto until_deadline = earliest_deadline - frame_pacer::clock::now();
+                timeout = std::clamp(std::chrono::ceil<std::chrono::milliseconds>(until_deadline),
+                                     std::chrono::milliseconds(0), max_idle_wait);
             }
+            profile_zone zone("wait_events");
+            renderers.front()->pump_events(timeout);
+        }
+        if (!rendered && !idle && earliest_deadline != frame_pacer::clock::time_point::max()) {
+            profile_zone zone("frame_pacing");
+            precise_sleep_until(earliest_deadline);
+        }
+        return rendered;
+    }
+    // runs the frames of a renderer with properties.threaded on its own thread until it is destroyed
+    static void run_thread(square::renderer *r) {
+        set_active_renderer(r);
+        r->activate_context();
+        while (!r->should_destroy()) {
+            auto now = frame_pacer::clock::now();
+            if (!r->pacer.is_due(now)) {
+                profile_zone zone("frame_pacing");
+                precise_sleep_until(r->pacer.next_deadline());
+            } else if (r->run_step()) {
+                r->pacer.start_frame(now);
+            } else {
+                profile_zone zone("wait_events");
+                r->wait_events(max_idle_wait);
+            }
+        }
+        r->release_context();
+        set_active_renderer(nullptr);
+        r->thread_finished = true;
+    }
+    // renderers on their own threads are detached once their thread has stopped using the context
+    static bool is_finished(const square::renderer &r) {
+        return r.properties.threaded ? r.thread_finished.load() : r.should_destroy();
+    }
+    static void detach_renderer(size_t i) {
+        auto r = std::move(instance().renderers[i]);
+        if (r->render_thread.joinable()) {
+            r->render_thread.join();
+        }
+        r->finish_update();
+        set_active_renderer(r.get());
+        r->activate_context();
+        r->load_object(nullptr); // unload active object
+        r->on_exit();
+        if (r->properties.print_frame_times) {
+            r->print_frame_times(std::cout);
+        }
+        r->destroy_context();
+        r->resources.reset();
+        instance().renderers.erase(instance().renderers.begin() + i);
+        set_active_renderer(nullptr);
+    }
+};
+// Times the GPU work submitted in the scope it is declared in.
+//
+// GPU zones cannot be nested, a zone opened while another GPU zone is open is ignored. Like profile_zone, the name must
+// outlive the capture.
+class gpu_profile_zone {
+  public:
+    gpu_profile_zone(renderer *r, const char *name) : r(r) {
+        if constexpr (profiler_enabled) {
+            r->begin_gpu_zone(name);
         }
     }
+    gpu_profile_zone(const gpu_profile_zone &) = delete;
+    gpu_profile_zone &operator=(const gpu_profile_zone &) = delete;
+    ~gpu_profile_zone() {
+        if constexpr (profiler_enabled) {
+            r->end_gpu_zone();
+        }
+    }
+
+  private:
+    renderer *r;
 };
 // An abstract base class for shaders
 class shader {
@@ -416,6 +902,9 @@ class buffer {
     template <typename T> void write_elements(size_t offset, const std::vector<T> &elems) {
         assert(offset + elems.size() <= size<T>());
         if (buffer_ptr) {
+            if (auto r = app::renderer()) {
+                r->get_frame_stats().buffer_bytes_written += sizeof(T) * elems.size();
+            }
             std::memcpy(static_cast<void *>(static_cast<T *>(buffer_ptr) + offset),
                         static_cast<const void *>(elems.data()), sizeof(T) * elems.size());
         }
@@ -435,10 +924,64 @@ class buffer {
     size_t size_in_bytes;
 };
 // An abstract base class for 2D textures. These are used in shaders with the sampler2D uniform
+//
+// Textures are allocated with a full mip chain and sampled with the texture's sampler settings when uploaded to a
+// shader.
 class texture2D : public buffer {
   public:
     texture2D() : buffer({}, buffer_access_type::STATIC, 0) {}
+    // false while an asynchronously loaded texture is still showing its placeholder
+    virtual bool is_ready() const { return true; }
+    // true if an asynchronously loaded texture could not be loaded, it keeps showing its placeholder
+    virtual bool has_failed() const { return false; }
+    inline void set_sampler(const sampler_settings &settings) { sampler = settings; }
+    inline const sampler_settings &get_sampler() const { return sampler; }
     virtual ~texture2D(){};
+
+  protected:
+    sampler_settings sampler{};
+};
+// An abstract base class for 2D texture arrays. These are used in shaders with the sampler2DArray uniform and are
+// uploaded with shader::upload_texture2D().
+//
+// Many images are packed into the layers of one texture so meshes using different images can be drawn by the same
+// draw call. Shaders select the image with the image's texture_region.
+class texture2D_array : public texture2D {
+  public:
+    inline const texture_region &get_region(size_t i) const { return regions[i]; }
+    inline const std::vector<texture_region> &get_regions() const { return regions; }
+    inline uint32_t get_layer_count() const { return layer_count; }
+    virtual ~texture2D_array(){};
+
+  protected:
+    std::vector<texture_region> regions;
+    uint32_t layer_count = 0;
+};
+// An abstract base class for offscreen framebuffers with a color and optionally a depth attachment.
+//
+// The color texture of a multisampled target holds the image resolved by resolve(). Depth textures are only available
+// for targets that are not multisampled. Attachment textures are sampled with bilinear filtering and clamped to their
+// edges.
+class render_target {
+  public:
+    render_target(uint32_t width, uint32_t height, int samples, bool depth)
+        : width(width), height(height), samples(samples), depth(depth) {}
+    inline uint32_t get_width() const { return width; }
+    inline uint32_t get_height() const { return height; }
+    inline int get_samples() const { return samples; }
+    inline bool has_depth() const { return depth; }
+    virtual const texture2D *get_color_texture() const = 0;
+    // nullptr for targets without a depth attachment or with multisampling
+    virtual const texture2D *get_depth_texture() const = 0;
+    // resolve the multisampled color attachment into the color texture, does nothing for targets without multisampling
+    virtual void resolve() = 0;
+    virtual ~render_target(){};
+
+  protected:
+    uint32_t width;
+    uint32_t height;
+    int samples;
+    bool depth;
 };
 // An abstract base class for vertex input assembly
 //
@@ -466,29 +1009,212 @@ class vertex_input_assembly {
     index_type type;
 };
 
-void renderer::run_step() {
+bool renderer::run_step() {
     if (active_object && !active_object->disabled) {
+        profile_zone frame_zone("frame");
         activate_context();
-        // remove objects marked for destruction
-        active_object->prune();
-        poll_events();
-        static auto t1 = std::chrono::high_resolution_clock::now();
-        auto t2 = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<float> time_span = std::chrono::duration_cast<std::chrono::duration<float>>(t2 - t1);
-        squint::quantities::time_f dt{time_span.count()};
-        t1 = t2;
-        update(properties.fixed_dt);
-        render(dt);
-        swap_buffers();
+        begin_frame();
+        // the tree and the events may only change between updates
+        finish_update();
+        {
+            // remove objects marked for destruction
+            profile_zone zone("prune");
+            active_object->prune();
+        }
+        {
+            profile_zone zone("poll_events");
+            input.begin_frame();
+            poll_events();
+        }
+        {
+            profile_zone zone("tasks");
+            scheduler.run(std::chrono::steady_clock::now());
+        }
+        // the renderer that sees a change first publishes it to the others
+        if (scene_changed.load(std::memory_order_relaxed) && scene_changed.exchange(false)) {
+            scene_generation++;
+        }
+        uint64_t generation = scene_generation.load();
+        if (!visible || (properties.on_demand && !redraw_requested && generation == rendered_generation)) {
+            // the time until the next frame is idle time, not a frame time
+            last_frame_start = {};
+            return false;
+        }
+        redraw_requested = false;
+        rendered_generation = generation;
+        auto frame_start = std::chrono::steady_clock::now();
+        squint::quantities::time_f dt{0.f};
+        // the first frame has no previous frame to measure from
+        if (last_frame_start != std::chrono::steady_clock::time_point{}) {
+            std::chrono::duration<float> time_span = frame_start - last_frame_start;
+            dt = squint::quantities::time_f{time_span.count()};
+            frame_times.record(std::chrono::duration_cast<std::chrono::nanoseconds>(time_span).count());
+        }
+        last_frame_start = frame_start;
+        run_update();
+        auto update_end = std::chrono::steady_clock::now();
+        if (properties.late_input_sampling && !properties.pipelined_update) {
+            profile_zone zone("poll_events");
+            // renderers on the main thread receive their events when they are pumped
+            if (!properties.threaded) {
+                pump_events(std::chrono::milliseconds(0));
+            }
+            poll_events();
+        }
+        {
+            profile_zone zone("render");
+            gpu_profile_zone gpu_zone(this, "render");
+            begin_render();
+            render(dt);
+            end_render();
+        }
+        auto render_end = std::chrono::steady_clock::now();
+        render_times.record(std::chrono::duration_cast<std::chrono::nanoseconds>(render_end - update_end).count());
+        {
+            profile_zone zone("swap_buffers");
+            swap_buffers();
+        }
+        if (first_input_arrival != std::chrono::steady_clock::time_point{}) {
+            auto latency = std::chrono::steady_clock::now() - first_input_arrival;
+            input_latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+            first_input_arrival = {};
+        }
+        last_frame_stats = frame_stats;
+        frame_stats = {};
+        // only warn when the budget is first exceeded
+        bool is_over_budget = over_budget();
+        if (is_over_budget && !was_over_budget) {
+            std::cerr << "RENDER WARNING: Frame exceeded its render_stats budget (" << last_frame_stats.draw_calls
+                      << " draw calls, " << last_frame_stats.instanced_draw_calls << " instanced draw calls, "
+                      << last_frame_stats.primitives << " primitives)" << std::endl;
+        }
+        was_over_budget = is_over_budget;
+        return true;
+    }
+    return false;
+}
+void renderer::run_update() {
+    if (!properties.pipelined_update) {
+        auto update_start = std::chrono::steady_clock::now();
+        {
+            profile_zone zone("update");
+            update(properties.fixed_dt);
+        }
+        auto update_time = std::chrono::steady_clock::now() - update_start;
+        update_times.record(std::chrono::duration_cast<std::chrono::nanoseconds>(update_time).count());
+        published_frame++;
+        return;
+    }
+    // render the state of the update that just finished while the next one is simulated
+    published_frame++;
+    pending_update = app::jobs().submit([this]() {
+        auto update_start = std::chrono::steady_clock::now();
+        {
+            app::scoped_active_renderer active(this);
+            profile_zone zone("update");
+            update(properties.fixed_dt);
+        }
+        auto update_time = std::chrono::steady_clock::now() - update_start;
+        return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(update_time).count());
+    });
+}
+void renderer::finish_update() {
+    if (pending_update.valid()) {
+        profile_zone zone("wait_update");
+        update_times.record(pending_update.get());
+    }
+}
+void renderer::set_visible(bool is_visible) {
+    if (is_visible && !visible) {
+        request_redraw();
     }
+    visible = is_visible;
+}
+void renderer::init_frame_times() {
+    frame_times.resize(properties.frame_time_window);
+    update_times.resize(properties.frame_time_window);
+    render_times.resize(properties.frame_time_window);
+    gpu_times.resize(properties.frame_time_window);
+    input_latencies.resize(properties.frame_time_window);
+    // vsync already paces frames to the display
+    bool vsync = properties.vsync && !properties.headless;
+    pacer.set_frame_rate(vsync ? 0.f : properties.max_frame_rate, properties.frame_time_window);
+    resolution = dynamic_resolution_controller(properties.min_resolution_scale, properties.max_resolution_scale,
+                                               properties.target_gpu_time);
+}
+void renderer::record_gpu_time(int64_t duration_ns) {
+    gpu_times.record(duration_ns);
+    if (properties.dynamic_resolution) {
+        resolution.update(duration_ns);
+    }
+}
+void renderer::record_input_arrival(std::chrono::steady_clock::time_point arrival) {
+    if (first_input_arrival == std::chrono::steady_clock::time_point{} || arrival < first_input_arrival) {
+        first_input_arrival = arrival;
+    }
+}
+void renderer::print_frame_times(std::ostream &os) const {
+    auto print = [&os](const char *name, const rolling_histogram &histogram) {
+        percentile_summary summary = histogram.summary();
+        os << name << " (" << summary.count << " frames): p50 " << summary.p50.as_seconds() * 1000.f << " ms, p95 "
+           << summary.p95.as_seconds() * 1000.f << " ms, p99 " << summary.p99.as_seconds() * 1000.f << " ms, max "
+           << summary.max.as_seconds() * 1000.f << " ms" << std::endl;
+    };
+    os << properties.window_title << std::endl;
+    print("  frame", frame_times);
+    print("  update", update_times);
+    print("  render", render_times);
+    if (gpu_times.count() > 0) {
+        print("  gpu", gpu_times);
+    }
+    if (input_latencies.count() > 0) {
+        print("  input latency", input_latencies);
+    }
+    if (pacer.is_enabled()) {
+        print("  pacing jitter", pacer.get_jitter());
+    }
+}
+void renderer::update(squint::quantities::time_f dt) {
+    if (!properties.parallel_systems) {
+        active_object->update(dt);
+        return;
+    }
+    physics_runs.clear();
+    {
+        profile_zone zone("collect_physics");
+        active_object->collect_physics(dt, physics_runs);
+    }
+    // the systems run on the workers as if they ran on this thread
+    systems.run(physics_runs, app::jobs(), [r = app::renderer(), scheduler = task_scheduler::active()](auto &&job) {
+        app::scoped_active_renderer active(r, scheduler);
+        job();
+    });
 }
-void renderer::update(squint::quantities::time_f dt) { active_object->update(dt); }
 void renderer::render(squint::quantities::time_f dt) { active_object->render(dt); }
-bool renderer::on_key(const key_event &event) { return active_object->on_key(event); }
-bool renderer::on_mouse_button(const mouse_button_event &event) { return active_object->on_mouse_button(event); }
-bool renderer::on_mouse_move(const mouse_move_event &event) { return active_object->on_mouse_move(event); }
-bool renderer::on_mouse_wheel(const mouse_scroll_event &event) { return active_object->on_mouse_wheel(event); }
-bool renderer::on_resize(const window_resize_event &event) { return active_object->on_resize(event); }
+bool renderer::on_key(const key_event &event) {
+    input.record(event);
+    request_redraw();
+    return active_object->on_key(event);
+}
+bool renderer::on_mouse_button(const mouse_button_event &event) {
+    input.record(event);
+    request_redraw();
+    return active_object->on_mouse_button(event);
+}
+bool renderer::on_mouse_move(const mouse_move_event &event) {
+    input.record(event);
+    request_redraw();
+    return active_object->on_mouse_move(event);
+}
+bool renderer::on_mouse_wheel(const mouse_scroll_event &event) {
+    input.record(event);
+    request_redraw();
+    return active_object->on_mouse_wheel(event);
+}
+bool renderer::on_resize(const window_resize_event &event) {
+    request_redraw();
+    return active_object->on_resize(event);
+}
 void renderer::load_object(object *obj) {
     if (active_object) {
         active_object->on_unload();
@@ -7,22 +7,200 @@ module;
 #include <unordered_map>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <algorithm>
+#include <sstream>
+#include <mutex>
+#include <condition_variable>
+#include <iterator>
+#include <numeric>
+#include <bit>
+#include <deque>
+#include <array>
+#include <optional>
+#include <utility>
+#include <chrono>
+#include <cmath>
 export module square:sdl_gl;
 import :renderer;
 import :transform;
 import :system;
 import :mesh;
+import :profiler;
 import squint;
 
 export namespace square {
 
+class sdl_gl_program;
+class sdl_gl_texture_loader;
+struct sdl_gl_shared_objects;
+class sdl_gl_gpu_timer;
+class sdl_gl_frame_timer;
+class sdl_gl_render_target;
+render_stats &gl_frame_stats();
+// SDL keycodes of the keys with key events and the _DOWN event of each key
+inline constexpr std::pair<SDL_Keycode, key_event> sdl_gl_keycodes[] = {
+    {SDLK_SPACE, key_event::SPACE_DOWN},
+    {SDLK_QUOTE, key_event::APOSTROPHE_DOWN},
+    {SDLK_COMMA, key_event::COMMA_DOWN},
+    {SDLK_MINUS, key_event::MINUS_DOWN},
+    {SDLK_PERIOD, key_event::PERIOD_DOWN},
+    {SDLK_SLASH, key_event::FORWARD_SLASH_DOWN},
+    {SDLK_0, key_event::ZERO_DOWN},
+    {SDLK_1, key_event::ONE_DOWN},
+    {SDLK_2, key_event::TWO_DOWN},
+    {SDLK_3, key_event::THREE_DOWN},
+    {SDLK_4, key_event::FOUR_DOWN},
+    {SDLK_5, key_event::FIVE_DOWN},
+    {SDLK_6, key_event::SIX_DOWN},
+    {SDLK_7, key_event::SEVEN_DOWN},
+    {SDLK_8, key_event::EIGHT_DOWN},
+    {SDLK_9, key_event::NINE_DOWN},
+    {SDLK_SEMICOLON, key_event::SEMICOLON_DOWN},
+    {SDLK_EQUALS, key_event::EQUAL_DOWN},
+    {SDLK_a, key_event::A_DOWN},
+    {SDLK_b, key_event::B_DOWN},
+    {SDLK_c, key_event::C_DOWN},
+    {SDLK_d, key_event::D_DOWN},
+    {SDLK_e, key_event::E_DOWN},
+    {SDLK_f, key_event::F_DOWN},
+    {SDLK_g, key_event::G_DOWN},
+    {SDLK_h, key_event::H_DOWN},
+    {SDLK_i, key_event::I_DOWN},
+    {SDLK_j, key_event::J_DOWN},
+    {SDLK_k, key_event::K_DOWN},
+    {SDLK_l, key_event::L_DOWN},
+    {SDLK_m, key_event::M_DOWN},
+    {SDLK_n, key_event::N_DOWN},
+    {SDLK_o, key_event::O_DOWN},
+    {SDLK_p, key_event::P_DOWN},
+    {SDLK_q, key_event::Q_DOWN},
+    {SDLK_r, key_event::R_DOWN},
+    {SDLK_s, key_event::S_DOWN},
+    {SDLK_t, key_event::T_DOWN},
+    {SDLK_u, key_event::U_DOWN},
+    {SDLK_v, key_event::V_DOWN},
+    {SDLK_w, key_event::W_DOWN},
+    {SDLK_x, key_event::X_DOWN},
+    {SDLK_y, key_event::Y_DOWN},
+    {SDLK_z, key_event::Z_DOWN},
+    {SDLK_LEFTBRACKET, key_event::LEFT_BRACKET_DOWN},
+    {SDLK_RIGHTBRACKET, key_event::RIGHT_BRACKET_DOWN},
+    {SDLK_BACKQUOTE, key_event::GRAVE_ACCENT_DOWN},
+    {SDLK_ESCAPE, key_event::ESCAPE_DOWN},
+    {SDLK_RETURN, key_event::ENTER_DOWN},
+    {SDLK_TAB, key_event::TAB_DOWN},
+    {SDLK_BACKSPACE, key_event::BACKSPACE_DOWN},
+    {SDLK_INSERT, key_event::INSERT_DOWN},
+    {SDLK_DELETE, key_event::DELETE_DOWN},
+    {SDLK_LEFT, key_event::LEFT_DOWN},
+    {SDLK_RIGHT, key_event::RIGHT_DOWN},
+    {SDLK_UP, key_event::UP_DOWN},
+    {SDLK_DOWN, key_event::DOWN_DOWN},
+    {SDLK_PAGEUP, key_event::PAGE_UP_DOWN},
+    {SDLK_PAGEDOWN, key_event::PAGE_DOWN_DOWN},
+    {SDLK_HOME, key_event::HOME_DOWN},
+    {SDLK_END, key_event::END_DOWN},
+    {SDLK_CAPSLOCK, key_event::CAPS_LOCK_DOWN},
+    {SDLK_SCROLLLOCK, key_event::SCROLL_LOCK_DOWN},
+    {SDLK_NUMLOCKCLEAR, key_event::NUM_LOCK_DOWN},
+    {SDLK_PRINTSCREEN, key_event::PRINT_SCREEN_DOWN},
+    {SDLK_PAUSE, key_event::PAUSE_DOWN},
+    {SDLK_F1, key_event::F1_DOWN},
+    {SDLK_F2, key_event::F2_DOWN},
+    {SDLK_F3, key_event::F3_DOWN},
+    {SDLK_F4, key_event::F4_DOWN},
+    {SDLK_F5, key_event::F5_DOWN},
+    {SDLK_F6, key_event::F6_DOWN},
+    {SDLK_F7, key_event::F7_DOWN},
+    {SDLK_F8, key_event::F8_DOWN},
+    {SDLK_F9, key_event::F9_DOWN},
+    {SDLK_F10, key_event::F10_DOWN},
+    {SDLK_F11, key_event::F11_DOWN},
+    {SDLK_F12, key_event::F12_DOWN},
+    {SDLK_KP_0, key_event::KEY_PAD_0_DOWN},
+    {SDLK_KP_1, key_event::KEY_PAD_1_DOWN},
+    {SDLK_KP_2, key_event::KEY_PAD_2_DOWN},
+    {SDLK_KP_3, key_event::KEY_PAD_3_DOWN},
+    {SDLK_KP_4, key_event::KEY_PAD_4_DOWN},
+    {SDLK_KP_5, key_event::KEY_PAD_5_DOWN},
+    {SDLK_KP_6, key_event::KEY_PAD_6_DOWN},
+    {SDLK_KP_7, key_event::KEY_PAD_7_DOWN},
+    {SDLK_KP_8, key_event::KEY_PAD_8_DOWN},
+    {SDLK_KP_9, key_event::KEY_PAD_9_DOWN},
+    {SDLK_KP_DECIMAL, key_event::KEY_PAD_DECIMAL_DOWN},
+    {SDLK_KP_DIVIDE, key_event::KEY_PAD_DIVIDE_DOWN},
+    {SDLK_KP_MULTIPLY, key_event::KEY_PAD_MULTIPLY_DOWN},
+    {SDLK_KP_MINUS, key_event::KEY_PAD_SUBTRACT_DOWN},
+    {SDLK_KP_PLUS, key_event::KEY_PAD_ADD_DOWN},
+    {SDLK_KP_ENTER, key_event::KEY_PAD_ENTER_DOWN},
+    {SDLK_KP_EQUALS, key_event::KEY_PAD_EQUAL_DOWN},
+    {SDLK_LSHIFT, key_event::LEFT_SHIFT_DOWN},
+    {SDLK_LCTRL, key_event::LEFT_CONTROL_DOWN},
+    {SDLK_LALT, key_event::LEFT_ALT_DOWN},
+    {SDLK_LGUI, key_event::LEFT_SUPER_DOWN},
+    {SDLK_RSHIFT, key_event::RIGHT_SHIFT_DOWN},
+    {SDLK_RCTRL, key_event::RIGHT_CONTROL_DOWN},
+    {SDLK_RALT, key_event::RIGHT_ALT_DOWN},
+    {SDLK_RGUI, key_event::RIGHT_SUPER_DOWN},
+    {SDLK_MENU, key_event::MENU_DOWN},
+};
+// Maps SDL keycodes to key events with table lookups. Keycodes of printable keys are their character, below 128, and
+// the keycodes of other keys are their scancode with SDLK_SCANCODE_MASK set.
+class sdl_gl_key_table {
+  public:
+    constexpr sdl_gl_key_table() {
+        printable.fill(-1);
+        other.fill(-1);
+        for (const auto &[keycode, down] : sdl_gl_keycodes) {
+            slot(keycode) = static_cast<int16_t>(down);
+        }
+    }
+    // the _DOWN event of the key, or nothing for keys without key events
+    constexpr std::optional<key_event> down_event(SDL_Keycode keycode) const {
+        if (keycode < 0 || (keycode >= 128 && !(keycode & SDLK_SCANCODE_MASK)) ||
+            (keycode & ~SDLK_SCANCODE_MASK) >= SDL_NUM_SCANCODES) {
+            return std::nullopt;
+        }
+        int16_t event = keycode & SDLK_SCANCODE_MASK ? other[keycode & ~SDLK_SCANCODE_MASK] : printable[keycode];
+        return event < 0 ? std::nullopt : std::optional<key_event>(static_cast<key_event>(event));
+    }
+
+  private:
+    constexpr int16_t &slot(SDL_Keycode keycode) {
+        return keycode & SDLK_SCANCODE_MASK ? other[keycode & ~SDLK_SCANCODE_MASK] : printable[keycode];
+    }
+    std::array<int16_t, 128> printable{};
+    std::array<int16_t, SDL_NUM_SCANCODES> other{};
+};
+inline constexpr sdl_gl_key_table sdl_gl_keys{};
+// Events the main thread received for a renderer. The renderer swaps the events out with a vector of its own, so the
+// memory of both is reused from frame to frame.
+struct sdl_gl_event_inbox {
+    sdl_gl_event_inbox() { events.reserve(initial_capacity); }
+    inline static constexpr size_t initial_capacity = 256;
+    std::mutex mutex;
+    std::condition_variable received; // notified when events arrive, renderers on their own threads wait for it
+    std::vector<SDL_Event> events;
+    void push(const SDL_Event &event) {
+        {
+            std::lock_guard lock(mutex);
+            events.push_back(event);
+        }
+        received.notify_one();
+    }
+};
 class sdl_gl_renderer : public renderer {
     friend class app;
 
   public:
     virtual ~sdl_gl_renderer();
-    static void init();
+    // initialize SDL. When headless is true, SDL uses its offscreen video driver which creates EGL contexts without a
+    // display server, e.g. on render servers and in CI. Headless renderers must also set properties.headless.
+    static void init(bool headless = false);
     static void quit();
+    // wake the app and the renderers waiting for events, safe to call from any thread
+    static void wake();
     virtual void clear_color_buffer(squint::fvec4 color) override final;
     virtual void wireframe_mode(bool enable) override final;
     virtual void clear_depth_buffer() override final;
@@ -30,26 +208,56 @@ class sdl_gl_renderer : public renderer {
     virtual void enable_depth_testing(bool enable) override final;
     virtual void enable_blending(bool enable) override final;
     virtual std::unique_ptr<shader> gen_shader(const std::string &name,
-                                               const std::filesystem::path &shader_src_directory) override final;
+                                               const std::filesystem::path &shader_src_directory,
+                                               const std::vector<std::string> &defines = {}) override final;
     virtual std::unique_ptr<shader> gen_shader(const std::string &name,
-                                               const std::vector<shader_src> &shader_sources) override final;
+                                               const std::vector<shader_src> &shader_sources,
+                                               const std::vector<std::string> &defines = {}) override final;
     virtual std::unique_ptr<buffer> gen_buffer(const void *data, const size_t size_in_bytes,
                                                const buffer_format &format,
                                                const buffer_access_type type) override final;
     virtual std::unique_ptr<texture2D> gen_texture(const std::filesystem::path &image_filepath) override final;
+    virtual std::shared_ptr<texture2D> load_texture(const std::filesystem::path &image_filepath) override final;
+    virtual std::unique_ptr<texture2D_array>
+    gen_texture_array(const std::vector<std::filesystem::path> &image_filepaths,
+                      texture_packing packing = texture_packing::LAYERS) override final;
     virtual std::unique_ptr<vertex_input_assembly> gen_vertex_input_assembly(index_type type) override final;
     virtual void draw_mesh(const simple_mesh *m, const transform *model, material *mat) override final;
     virtual void draw_mesh(const instanced_mesh *m, const transform *model, material *mat,
                            unsigned int instance_count) override final;
     virtual void set_viewport(size_t x, size_t y, size_t width, size_t height) override final;
     virtual void set_cursor(cursor_type type) override final;
+    virtual std::unique_ptr<render_target> gen_render_target(uint32_t width, uint32_t height, int samples = 1,
+                                                             bool depth = true) override final;
+    virtual void bind_render_target(render_target *target) override final;
+    virtual void present_render_target(render_target *target, uint32_t width, uint32_t height,
+                                       texture_filter filter = texture_filter::LINEAR) override final;
+    virtual framebuffer_image read_framebuffer() override final;
+    // get the sampler object for the settings, creating it the first time the settings are used
+    GLuint get_sampler(const sampler_settings &settings);
+    virtual void begin_gpu_zone(const char *name) override final;
+    virtual void end_gpu_zone() override final;
 
   private:
     void create_context() override final;
     void poll_events() override final;
+    void wait_events(std::chrono::milliseconds timeout) override final;
+    // Take the events in the SDL queue and put them in the inboxes of the windows they belong to. SDL_QUIT and wake()
+    // events go to every inbox, events of other windows are dropped. Must be called on the main thread.
+    void pump_events(std::chrono::milliseconds timeout) override final;
+    void handle_event(const SDL_Event &event);
     void destroy_context() override final;
     void activate_context() override final;
+    void release_context() override final;
     void swap_buffers() override final;
+    void begin_frame() override final;
+    void begin_render() override final;
+    void end_render() override final;
+    void create_default_framebuffer();
+    // the framebuffer the loaded object is rendered into this frame and its size
+    GLuint frame_framebuffer() const;
+    uint32_t frame_width() const;
+    uint32_t frame_height() const;
     using renderer::on_key;
     using renderer::on_mouse_button;
     using renderer::on_mouse_move;
@@ -60,25 +268,57 @@ class sdl_gl_renderer : public renderer {
     SDL_GLContext glcontext = nullptr;
     SDL_Window *window = nullptr;
     unsigned int window_id = 0;
-    std::unordered_map<std::string, GLint> shader_name_binding_cache;
+    // event type pushed by wake(), registered by init()
+    inline static uint32_t wake_event = static_cast<uint32_t>(-1);
+    // inboxes of every renderer by window id, only used on the main thread
+    inline static std::unordered_map<uint32_t, std::shared_ptr<sdl_gl_event_inbox>> inboxes;
+    std::shared_ptr<sdl_gl_event_inbox> inbox;
+    std::vector<SDL_Event> inbox_events; // events taken from the inbox, kept to reuse its memory
+    // programs, textures and samplers shared with the renderers of the resource group
+    std::shared_ptr<sdl_gl_shared_objects> shared;
+    float max_anisotropy = 1.f;
+    std::unique_ptr<sdl_gl_gpu_timer> gpu_timer; // only created when the profiler is enabled
+    // headless renderers draw into this framebuffer instead of the window's
+    GLuint default_framebuffer = 0;
+    GLuint color_renderbuffer = 0;
+    GLuint depth_renderbuffer = 0;
+    // fences of the frames the GPU may still be rendering, oldest first
+    std::deque<GLsync> frame_fences;
+    size_t frames_in_flight_limit() const;
+    std::unique_ptr<sdl_gl_frame_timer> frame_timer;
+    // with dynamic resolution, the loaded object is rendered into the top left scene_width by scene_height texels of
+    // this target which is sized for the largest scale
+    std::unique_ptr<sdl_gl_render_target> scene_target;
+    bool scene_target_bound = false;
+    uint32_t scene_width = 0;
+    uint32_t scene_height = 0;
 };
-class sdl_gl_shader : public shader {
-
+// A linked GL program along with the reflection data (uniform locations and binding points) queried from it.
+//
+// Programs are shared by every sdl_gl_shader generated from the same sources so the reflection data is only queried
+// once per program. The program is deleted when the last shader referencing it is destroyed.
+class sdl_gl_program {
   public:
-    virtual void activate() override final;
-    sdl_gl_shader(const std::filesystem::path &shader_src_folder);
-    sdl_gl_shader(const std::vector<shader_src> &shader_sources);
-    sdl_gl_shader(GLint program) : program(program) {}
-    virtual ~sdl_gl_shader();
-    virtual void upload_mat4(const std::string &name, const squint::fmat4 &value,
-                             bool suppress_warnings = false) override final;
-    virtual void upload_vec4(const std::string &name, const squint::fvec4 &value,
-                             bool suppress_warnings = false) override final;
-    virtual void upload_texture2D(const std::string &name, const texture2D *texture,
-                                  bool suppress_warnings = false) override final;
-    virtual void upload_storage_buffer(const std::string &name, const buffer *ssbo,
-                                       bool suppress_warnings = false) override final;
-    virtual uint32_t get_id() override final;
+    sdl_gl_program(const std::vector<shader_src> &sources, const std::string &label);
+    ~sdl_gl_program() { glDeleteProgram(program); } // Silently ignored if program is 0
+    // delete the program before all shaders referencing it are destroyed. Used when the context is destroyed.
+    void release();
+    inline GLuint get_id() const { return program; }
+    // true if the program was linked from these sources, used to tell programs apart when their hashes collide
+    bool has_sources(const std::vector<shader_src> &other) const;
+    // location of a uniform or -1 if the program has no uniform with this name
+    GLint uniform_location(const std::string &name);
+    // texture unit assigned to a sampler uniform or -1 if the program has no sampler with this name
+    GLint texture_unit(const std::string &name);
+    // binding point assigned to a storage block or -1 if the program has no storage block with this name
+    GLint storage_binding(const std::string &name);
+    // read all shader sources in a directory. The type of each source is determined by its file extension.
+    static std::vector<shader_src> read_sources(const std::filesystem::path &shader_src_directory);
+    // insert the defines after the '#version' directive of each source
+    static std::vector<shader_src> apply_defines(const std::vector<shader_src> &sources,
+                                                 const std::vector<std::string> &defines);
+    // hash of the shader types and sources used to deduplicate programs
+    static size_t hash_sources(const std::vector<shader_src> &sources);
 
   private:
     inline static const std::unordered_map<std::string, shader_type> shader_ext_type{
@@ -93,13 +333,36 @@ class sdl_gl_shader : public shader {
         {shader_type::FRAGMENT_SHADER, GL_FRAGMENT_SHADER},
         {shader_type::COMPUTE_SHADER, GL_COMPUTE_SHADER}};
     static shader_src read_shader(const std::filesystem::path &shader_src_filepath);
-    GLuint compile_shader(const shader_src &source);
-    GLuint create_program(const std::vector<shader_src> &sources);
+    static GLuint compile_shader(const shader_src &source);
+    static GLuint create_program(const std::vector<shader_src> &sources);
     GLuint program;
-    std::unordered_map<std::string, GLint> resource_location_cache;
+    std::vector<shader_src> sources;
+    std::unordered_map<std::string, GLint> uniform_location_cache;
     std::unordered_map<std::string, GLint> texture_binding_cache;
     std::unordered_map<std::string, GLint> storage_binding_cache;
 };
+// A shader is a handle to a shared sdl_gl_program. Many materials can hold shaders referencing the same program.
+class sdl_gl_shader : public shader {
+
+  public:
+    virtual void activate() override final;
+    sdl_gl_shader(std::shared_ptr<sdl_gl_program> program) : program(std::move(program)) {}
+    virtual ~sdl_gl_shader();
+    virtual void upload_mat4(const std::string &name, const squint::fmat4 &value,
+                             bool suppress_warnings = false) override final;
+    virtual void upload_vec4(const std::string &name, const squint::fvec4 &value,
+                             bool suppress_warnings = false) override final;
+    virtual void upload_texture2D(const std::string &name, const texture2D *texture,
+                                  bool suppress_warnings = false) override final;
+    virtual void upload_storage_buffer(const std::string &name, const buffer *ssbo,
+                                       bool suppress_warnings = false) override final;
+    virtual uint32_t get_id() override final;
+    // the binding point the program declares for a storage block, or -1 if it has no such block
+    GLint storage_binding(const std::string &name);
+
+  private:
+    std::shared_ptr<sdl_gl_program> program;
+};
 class sdl_gl_buffer : public buffer {
   public:
     sdl_gl_buffer(const void *data, const size_t size_in_bytes, const buffer_format &format,
@@ -124,31 +387,219 @@ class sdl_gl_buffer : public buffer {
             break;
         }
         glNamedBufferStorage(buffer_id, size_in_bytes, data, flags);
+        gpu_memory.buffer_bytes += static_cast<int64_t>(size_in_bytes);
+        if (data) {
+            gl_frame_stats().buffer_bytes_written += size_in_bytes;
+        }
         if (type != buffer_access_type::STATIC) {
             buffer_ptr = glMapNamedBufferRange(buffer_id, 0, size_in_bytes, flags);
         }
     }
     virtual const uint32_t get_id() const override final { return buffer_id; }
-    ~sdl_gl_buffer() { glDeleteBuffers(1, &buffer_id); }
+    ~sdl_gl_buffer() {
+        glDeleteBuffers(1, &buffer_id);
+        gpu_memory.buffer_bytes -= static_cast<int64_t>(size_in_bytes);
+    }
 
   private:
     GLuint buffer_id;
 };
+// Decoded image data with tightly packed rows. Images can be decoded on any thread and uploaded on the GL thread.
+//
+// Precomputed mip levels are read from files next to the image named <stem>.mip<level><extension>, for example
+// earth.mip1.jpg, earth.mip2.jpg, etc. If there are none, the mip chain is generated when the image is uploaded.
+struct sdl_gl_image {
+    int width = 0;
+    int height = 0;
+    texture_type type = texture_type::RGBA8;
+    std::vector<uint8_t> pixels;
+    std::vector<std::vector<uint8_t>> mip_levels; // precomputed levels starting at level 1
+    // read an image file and its precomputed mip levels. Throws if the image could not be read.
+    static sdl_gl_image decode(const std::filesystem::path &image_filepath);
+
+  private:
+    static sdl_gl_image read_level(const std::filesystem::path &image_filepath);
+};
 class sdl_gl_texture2D : public texture2D {
   public:
-    sdl_gl_texture2D(const std::filesystem::path &image_filepath);
+    // read and upload an image file
+    sdl_gl_texture2D(const std::filesystem::path &image_filepath)
+        : sdl_gl_texture2D(sdl_gl_image::decode(image_filepath)) {}
+    // upload decoded image data
+    sdl_gl_texture2D(const sdl_gl_image &image) { upload(image); }
+    // construct a texture that samples the placeholder texture until image data is uploaded. The placeholder is not
+    // owned by this texture.
+    sdl_gl_texture2D(GLuint placeholder_id) : texture_id(placeholder_id) {}
+    // create the texture storage and upload image data through a pixel unpack buffer
+    void upload(const sdl_gl_image &image);
     virtual const uint32_t get_id() const override final { return texture_id; }
+    virtual bool is_ready() const override final { return ready; }
+    virtual bool has_failed() const override final { return failed; }
+    // called by the texture loader when the image could not be decoded
+    inline void fail() { failed = true; }
     ~sdl_gl_texture2D() {
-        glDeleteBuffers(1, &buffer_id);
+        if (ready) {
+            glDeleteTextures(1, &texture_id);
+            gpu_memory.texture_bytes -= allocated_bytes;
+        }
+    }
+
+  private:
+    GLuint texture_id = 0;
+    int64_t allocated_bytes = 0;
+    texture_type tex_type = texture_type::RGBA8;
+    int width = 0;
+    int height = 0;
+    bool ready = false;
+    bool failed = false;
+};
+// Images of the same format packed into the layers of a GL_TEXTURE_2D_ARRAY.
+//
+// Atlas pages are packed with shelves: images are placed tallest first, left to right along a shelf, and a new shelf
+// or page is started when an image doesn't fit. Each image is surrounded by a gutter filled with its edge texels and
+// placed on a multiple of the texel block size of the last mip level. The mip chain stops before the gutter is filtered
+// away so neighbouring images don't bleed into each other.
+class sdl_gl_texture2D_array : public texture2D_array {
+  public:
+    sdl_gl_texture2D_array(const std::vector<std::filesystem::path> &image_filepaths, texture_packing packing,
+                           int atlas_size);
+    virtual const uint32_t get_id() const override final { return texture_id; }
+    ~sdl_gl_texture2D_array() {
         glDeleteTextures(1, &texture_id);
+        gpu_memory.texture_bytes -= allocated_bytes;
     }
 
   private:
-    GLuint buffer_id;
+    int64_t allocated_bytes = 0;
+    // copy an image and its gutter into an atlas page with its top left gutter texel at (x, y)
+    static void copy_padded(const sdl_gl_image &image, size_t texel_bytes, std::vector<uint8_t> &page, int page_size,
+                            int x, int y);
+    inline static constexpr int atlas_padding = 4;
+    GLuint texture_id = 0;
+};
+// A texture owned by a render target
+class sdl_gl_attachment_texture : public texture2D {
+  public:
+    sdl_gl_attachment_texture(GLuint texture_id) : texture_id(texture_id) {
+        sampler = {texture_filter::LINEAR, texture_wrap::CLAMP_TO_EDGE};
+    }
+    virtual const uint32_t get_id() const override final { return texture_id; }
+
+  private:
     GLuint texture_id;
-    texture_type tex_type;
-    int width;
-    int height;
+};
+// A framebuffer with a color texture and an optional depth texture. Multisampled targets render into multisampled
+// renderbuffers and resolve them into a second framebuffer holding the color texture.
+class sdl_gl_render_target : public render_target {
+  public:
+    sdl_gl_render_target(uint32_t width, uint32_t height, int samples, bool depth);
+    ~sdl_gl_render_target();
+    virtual const texture2D *get_color_texture() const override final { return color_texture.get(); }
+    virtual const texture2D *get_depth_texture() const override final { return depth_texture.get(); }
+    virtual void resolve() override final { resolve(width, height); }
+    // resolve the region from the origin to width by height
+    void resolve(uint32_t width, uint32_t height);
+    inline GLuint get_framebuffer() const { return framebuffer; }
+    // the framebuffer the color texture is attached to
+    inline GLuint get_resolve_framebuffer() const { return resolve_framebuffer ? resolve_framebuffer : framebuffer; }
+
+  private:
+    GLuint framebuffer = 0;
+    GLuint resolve_framebuffer = 0;
+    GLuint color_texture_id = 0;
+    GLuint depth_texture_id = 0;
+    GLuint color_renderbuffer = 0;
+    GLuint depth_renderbuffer = 0;
+    int64_t allocated_bytes = 0;
+    std::unique_ptr<sdl_gl_attachment_texture> color_texture;
+    std::unique_ptr<sdl_gl_attachment_texture> depth_texture;
+};
+// Loads textures without blocking the GL thread.
+//
+// Images are decoded on the app's worker threads and uploaded on the GL thread in process_uploads(). Requests are
+// deduplicated by path so every user of an image shares one texture. Textures are dropped from the cache once they are
+// no longer referenced.
+class sdl_gl_texture_loader {
+  public:
+    sdl_gl_texture_loader();
+    ~sdl_gl_texture_loader() { glDeleteTextures(1, &placeholder_id); }
+    std::shared_ptr<texture2D> load(const std::filesystem::path &image_filepath);
+    // upload decoded images until byte_budget bytes have been uploaded. At least one image is uploaded per call so
+    // images larger than the budget are not starved.
+    // Returns the number of textures uploaded.
+    size_t process_uploads(size_t byte_budget);
+
+  private:
+    struct decoded_image {
+        std::string key;
+        sdl_gl_image image;
+        std::string error;
+    };
+    // shared with the decode jobs so they can finish after the loader is destroyed
+    struct decode_queue {
+        std::mutex mutex;
+        std::vector<decoded_image> images;
+    };
+    std::shared_ptr<decode_queue> decoded = std::make_shared<decode_queue>();
+    std::unordered_map<std::string, std::weak_ptr<sdl_gl_texture2D>> textures;
+    GLuint placeholder_id = 0;
+};
+// The GL objects shared by the renderers of a resource group.
+//
+// The contexts of the renderers in a group are created in one share group, so programs, buffers, textures and
+// samplers created by any of them can be used by all. Vertex array objects are not shared between contexts, so meshes
+// still belong to the renderer that created them.
+struct sdl_gl_shared_objects {
+    ~sdl_gl_shared_objects();
+    // the renderers of the group with a context, new contexts share objects with the first of them
+    std::vector<sdl_gl_renderer *> renderers;
+    // linked programs keyed by the hash of their sources and defines. Different sources can have the same hash, so a
+    // hash can have several programs. Entries expire when the last shader using the program is destroyed.
+    std::unordered_multimap<size_t, std::weak_ptr<sdl_gl_program>> program_cache;
+    std::unique_ptr<sdl_gl_texture_loader> texture_loader;
+    std::vector<std::pair<sampler_settings, GLuint>> sampler_cache;
+};
+// Times GPU work with GL_TIME_ELAPSED queries and records the results with the profiler.
+//
+// Results are collected at the start of later frames once they are available so reading them never stalls the GL
+// thread. Only one GL_TIME_ELAPSED query can be active at a time, so zones begun while another zone is open are
+// ignored.
+class sdl_gl_gpu_timer {
+  public:
+    ~sdl_gl_gpu_timer();
+    void begin(const char *name);
+    void end();
+    // record the zones whose results are available
+    void collect();
+
+  private:
+    struct pending_zone {
+        GLuint query;
+        const char *name;
+        int64_t start_ns;
+    };
+    std::vector<GLuint> free_queries;
+    std::deque<pending_zone> pending;
+    int depth = 0;
+};
+// Measures the GPU time of each frame with GL_TIMESTAMP queries, which unlike GL_TIME_ELAPSED queries can overlap the
+// profiler's GPU zones. Like the GPU timer, results are read once they are available so reading them never stalls.
+class sdl_gl_frame_timer {
+  public:
+    sdl_gl_frame_timer();
+    ~sdl_gl_frame_timer() { glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data()); }
+    void begin();
+    void end();
+    // get the GPU time of the oldest measured frame whose result is available, returns false if there is none
+    bool next_result(int64_t &duration_ns);
+
+  private:
+    // frames in flight that can be measured, later frames are skipped until a result is read
+    inline static constexpr size_t frame_count = 4;
+    std::array<GLuint, 2 * frame_count> queries{}; // start and end timestamps of each frame
+    std::vector<size_t> free_frames;
+    std::deque<size_t> pending;
+    int current = -1;
 };
 class sdl_gl_vertex_input_assembly : public vertex_input_assembly {
   public:
@@ -177,7 +628,10 @@ class sdl_gl_vertex_input_assembly : public vertex_input_assembly {
             }
         }
     }
-    virtual void activate() const override final { glBindVertexArray(vao); }
+    virtual void activate() const override final {
+        glBindVertexArray(vao);
+        gl_frame_stats().vertex_array_binds++;
+    }
     ~sdl_gl_vertex_input_assembly() { glDeleteVertexArrays(1, &vao); }
 
   private:
@@ -369,6 +823,67 @@ GLenum gl_tex_type(texture_type type) {
         return GL_NONE;
     }
 }
+GLenum gl_min_filter(texture_filter filter) {
+    switch (filter) {
+    case texture_filter::NEAREST:
+        return GL_NEAREST_MIPMAP_NEAREST;
+    case texture_filter::LINEAR:
+        return GL_LINEAR_MIPMAP_NEAREST;
+    case texture_filter::TRILINEAR:
+        return GL_LINEAR_MIPMAP_LINEAR;
+    default:
+        return GL_NONE;
+    }
+}
+GLenum gl_mag_filter(texture_filter filter) {
+    switch (filter) {
+    case texture_filter::NEAREST:
+        return GL_NEAREST;
+    case texture_filter::LINEAR:
+        return GL_LINEAR;
+    case texture_filter::TRILINEAR:
+        return GL_LINEAR;
+    default:
+        return GL_NONE;
+    }
+}
+GLenum gl_wrap(texture_wrap wrap) {
+    switch (wrap) {
+    case texture_wrap::REPEAT:
+        return GL_REPEAT;
+    case texture_wrap::MIRRORED_REPEAT:
+        return GL_MIRRORED_REPEAT;
+    case texture_wrap::CLAMP_TO_EDGE:
+        return GL_CLAMP_TO_EDGE;
+    default:
+        return GL_NONE;
+    }
+}
+// counters of the frame being rendered by the active renderer
+render_stats &gl_frame_stats() {
+    if (auto r = app::renderer()) {
+        return r->get_frame_stats();
+    }
+    // work done outside of a frame isn't counted
+    static render_stats discarded{};
+    return discarded;
+}
+// bytes of texture storage for levels mip levels of layers images of texel_bytes sized texels
+int64_t gl_texture_storage_bytes(int width, int height, int layers, int levels, size_t texel_bytes) {
+    int64_t bytes = 0;
+    for (int level = 0; level < levels; level++) {
+        bytes += static_cast<int64_t>(std::max(1, width >> level)) * std::max(1, height >> level);
+    }
+    return bytes * layers * static_cast<int64_t>(texel_bytes);
+}
+// number of levels in a full mip chain down to 1x1
+int gl_mip_level_count(int width, int height) {
+    int levels = 1;
+    for (int size = std::max(width, height); size > 1; size >>= 1) {
+        levels++;
+    }
+    return levels;
+}
 void GLAPIENTRY debug_message_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
                                        const GLchar *message, const void *userParam) {
     auto debug_state = static_cast<const sdl_gl_renderer *>(userParam)->get_properties().debug;
@@ -394,39 +909,97 @@ void GLAPIENTRY debug_message_callback(GLenum source, GLenum type, GLuint id, GL
     }
 }
 sdl_gl_renderer::~sdl_gl_renderer() {}
-void sdl_gl_renderer::init() {
-    // SDL_SetHint(SDL_HINT_VIDEODRIVER, "wayland,x11");
-    SDL_SetHint(SDL_HINT_VIDEODRIVER, "x11"); // GLEW does not work on wayland yet
+void sdl_gl_renderer::init(bool headless) {
+    if (headless) {
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+    } else {
+        // SDL_SetHint(SDL_HINT_VIDEODRIVER, "wayland,x11");
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, "x11"); // GLEW does not work on wayland yet
+    }
     SDL_Init(SDL_INIT_VIDEO); // Init SDL2, VIDEO also inits EVENTS
+    wake_event = SDL_RegisterEvents(1);
     // Initialize PNG loading
     int imgFlags = IMG_INIT_PNG | IMG_INIT_JPG;
     if (!(IMG_Init(imgFlags) & imgFlags)) {
         throw std::runtime_error("SDL_image could not initialize! SDL_image Error: " + std::string(IMG_GetError()));
     }
 }
+void sdl_gl_renderer::wake() {
+    if (wake_event != static_cast<uint32_t>(-1)) {
+        SDL_Event event{};
+        event.type = wake_event;
+        SDL_PushEvent(&event);
+    }
+}
 void sdl_gl_renderer::quit() {
     IMG_Quit();
     SDL_Quit();
 }
 void sdl_gl_renderer::create_context() {
+    if (properties.threaded && properties.resource_group) {
+        // programs keep their uniform values, so renderers drawing with shared programs on different threads would
+        // overwrite each other's uniforms
+        std::cerr << "WARNING: renderers in a resource group run on the main thread, threaded is ignored" << std::endl;
+        properties.threaded = false;
+    }
     SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
     SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
     SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
     SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8);
     SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, properties.samples);
-    auto window_flag = properties.fullscreen ? SDL_WINDOW_FULLSCREEN : SDL_WINDOW_RESIZABLE;
+    // headless renderers multisample their own framebuffer, pbuffer configs often don't support multisampling. With
+    // dynamic resolution the scaled scene is multisampled instead, blitting it into a multisampled window would fail.
+    bool multisampled_window = !properties.headless && !properties.dynamic_resolution;
+    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, multisampled_window ? 1 : 0);
+    SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, multisampled_window ? properties.samples : 0);
+    Uint32 window_flag = properties.fullscreen ? SDL_WINDOW_FULLSCREEN : SDL_WINDOW_RESIZABLE;
+    if (properties.hidden || properties.headless) {
+        window_flag |= SDL_WINDOW_HIDDEN;
+    }
     window = SDL_CreateWindow(properties.window_title, 0, 0, properties.window_width, properties.window_height,
                               SDL_WINDOW_OPENGL | window_flag | SDL_WINDOW_ALLOW_HIGHDPI);
 
+    if (!window) {
+        throw std::runtime_error("Error SDL failed to create a window:\n" + std::string(SDL_GetError()) + "\n");
+    }
     window_id = SDL_GetWindowID(window);
+    inbox = std::make_shared<sdl_gl_event_inbox>();
+    inbox_events.reserve(sdl_gl_event_inbox::initial_capacity);
+    inboxes[window_id] = inbox;
+    shared = resources->get_or_create<sdl_gl_shared_objects>("sdl_gl", []() { return new sdl_gl_shared_objects(); });
+    if (!shared->renderers.empty()) {
+        // the new context shares objects with the context that is current when it is created
+        sdl_gl_renderer *member = shared->renderers.front();
+        SDL_GL_MakeCurrent(member->window, member->glcontext);
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+    }
     glcontext = SDL_GL_CreateContext(window);
-    if (properties.vsync) {
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+    if (!glcontext) {
+        throw std::runtime_error("Error SDL failed to create a GL context:\n" + std::string(SDL_GetError()) + "\n");
+    }
+    if (properties.vsync && !properties.headless) {
         SDL_GL_SetSwapInterval(1);
+    } else if (properties.limit_to_display_rate) {
+        SDL_DisplayMode mode;
+        int display = SDL_GetWindowDisplayIndex(window);
+        if (display >= 0 && SDL_GetCurrentDisplayMode(display, &mode) == 0 && mode.refresh_rate > 0) {
+            float refresh_rate = static_cast<float>(mode.refresh_rate);
+            if (properties.max_frame_rate <= 0.f || properties.max_frame_rate > refresh_rate) {
+                properties.max_frame_rate = refresh_rate;
+            }
+        } else {
+            std::cerr << "WARNING: display refresh rate is unknown, frames are limited to max_frame_rate" << std::endl;
+        }
     }
     GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // GLEW built for GLX reports this for EGL contexts, e.g. from the offscreen driver, after loading the GL functions
+    if (err == GLEW_ERROR_NO_GLX_DISPLAY) {
+        err = GLEW_OK;
+    }
+#endif
     if (GLEW_OK != err) {
         throw std::runtime_error("Error GLEW failed to initalize:\n" +
                                  std::string(reinterpret_cast<const char *>(glewGetErrorString(err))) + "\n");
@@ -445,733 +1018,317 @@ void sdl_gl_renderer::create_context() {
             std::cout << "SDL VIDEO DRIVER: " << SDL_GetCurrentVideoDriver() << std::endl;
         }
     }
+    if (!shared->texture_loader) {
+        shared->texture_loader = std::make_unique<sdl_gl_texture_loader>();
+    }
+    shared->renderers.push_back(this);
+    frame_timer = std::make_unique<sdl_gl_frame_timer>();
+    if constexpr (profiler_enabled) {
+        gpu_timer = std::make_unique<sdl_gl_gpu_timer>();
+    }
+    if (GLEW_EXT_texture_filter_anisotropic) {
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropy);
+    }
     set_cursor(properties.cursor);
     // set the window width and height and gl viewport to actual pixels since high DPI reports a scaled coordinate
     int w, h;
     SDL_GL_GetDrawableSize(window, &w, &h);
     properties.window_width = w;
     properties.window_height = h;
+    if (properties.headless) {
+        create_default_framebuffer();
+    }
     glViewport(0, 0, w, h);
 }
+void sdl_gl_renderer::create_default_framebuffer() {
+    GLsizei samples = properties.samples > 1 && !properties.dynamic_resolution ? properties.samples : 0;
+    auto width = static_cast<GLsizei>(properties.window_width);
+    auto height = static_cast<GLsizei>(properties.window_height);
+    glCreateRenderbuffers(1, &color_renderbuffer);
+    glNamedRenderbufferStorageMultisample(color_renderbuffer, samples, GL_RGBA8, width, height);
+    glCreateRenderbuffers(1, &depth_renderbuffer);
+    glNamedRenderbufferStorageMultisample(depth_renderbuffer, samples, GL_DEPTH24_STENCIL8, width, height);
+    glCreateFramebuffers(1, &default_framebuffer);
+    glNamedFramebufferRenderbuffer(default_framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_renderbuffer);
+    glNamedFramebufferRenderbuffer(default_framebuffer, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+                                   depth_renderbuffer);
+    if (glCheckNamedFramebufferStatus(default_framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error("Error headless framebuffer is incomplete\n");
+    }
+    // the binding is part of the context state so it only needs to be bound once
+    glBindFramebuffer(GL_FRAMEBUFFER, default_framebuffer);
+}
 void sdl_gl_renderer::poll_events() {
-    std::vector<SDL_Event> unhandled_events{};
+    // the app has put the events of this window in the inbox
+    {
+        std::lock_guard lock(inbox->mutex);
+        std::swap(inbox->events, inbox_events);
+    }
+    mouse_move_event motion{};
+    bool has_motion = false;
+    // SDL timestamps events in milliseconds of SDL_GetTicks() when they arrive
+    auto now = std::chrono::steady_clock::now();
+    Uint32 ticks = SDL_GetTicks();
+    for (const auto &event : inbox_events) {
+        switch (event.type) {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+        case SDL_MOUSEMOTION:
+        case SDL_MOUSEWHEEL:
+            record_input_arrival(now - std::chrono::milliseconds(ticks - event.common.timestamp));
+            break;
+        default:
+            break;
+        }
+        if (properties.coalesce_mouse_motion) {
+            if (event.type == SDL_MOUSEMOTION) {
+                motion = {event.motion.x, event.motion.y, motion.xrel + event.motion.xrel,
+                          motion.yrel + event.motion.yrel};
+                has_motion = true;
+                continue;
+            }
+            // buttons are pressed where the mouse has moved to
+            if (has_motion && (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP)) {
+                on_mouse_move(motion);
+                motion = {};
+                has_motion = false;
+            }
+        }
+        handle_event(event);
+    }
+    if (has_motion) {
+        on_mouse_move(motion);
+    }
+    inbox_events.clear();
+}
+void sdl_gl_renderer::wait_events(std::chrono::milliseconds timeout) {
+    std::unique_lock lock(inbox->mutex);
+    inbox->received.wait_for(lock, timeout, [this]() { return !inbox->events.empty(); });
+}
+void sdl_gl_renderer::pump_events(std::chrono::milliseconds timeout) {
+    if (timeout.count() > 0) {
+        SDL_WaitEventTimeout(nullptr, static_cast<int>(timeout.count()));
+    }
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
-        if (event.window.windowID == window_id) {
-            switch (event.type) {
-            case SDL_WINDOWEVENT:
-                switch (event.window.event) {
-                case SDL_WINDOWEVENT_CLOSE:
-                    destroy();
-                    break;
-                case SDL_WINDOWEVENT_RESIZED:
-                    // properties.window_width = static_cast<uint64_t>(event.window.data1);
-                    // properties.window_height = static_cast<uint64_t>(event.window.data2);
-                    // high DPI monitors will not report actual pixels, so we get them this way
-                    int w, h;
-                    SDL_GL_GetDrawableSize(window, &w, &h);
-                    properties.window_width = w;
-                    properties.window_height = h;
-                    on_resize({properties.window_width, properties.window_height});
-                    break;
-                default:
-                    break;
-                }
-                break;
-            case SDL_MOUSEBUTTONUP:
-                switch (event.button.button) {
-                case SDL_BUTTON_LEFT:
-                    on_mouse_button(mouse_button_event::LEFT_MOUSE_UP);
-                    break;
-                case SDL_BUTTON_RIGHT:
-                    on_mouse_button(mouse_button_event::RIGHT_MOUSE_UP);
-                    break;
-                case SDL_BUTTON_MIDDLE:
-                    on_mouse_button(mouse_button_event::MIDDLE_MOUSE_UP);
-                    break;
-                default:
-                    break;
-                }
-                break;
-            case SDL_MOUSEBUTTONDOWN:
-                switch (event.button.button) {
-                case SDL_BUTTON_LEFT:
-                    on_mouse_button(mouse_button_event::LEFT_MOUSE_DOWN);
-                    break;
-                case SDL_BUTTON_RIGHT:
-                    on_mouse_button(mouse_button_event::RIGHT_MOUSE_DOWN);
-                    break;
-                case SDL_BUTTON_MIDDLE:
-                    on_mouse_button(mouse_button_event::MIDDLE_MOUSE_DOWN);
-                    break;
-                default:
-                    break;
-                }
-                break;
-            case SDL_MOUSEWHEEL:
-                on_mouse_wheel({event.wheel.preciseX, event.wheel.preciseY});
-                break;
-            case SDL_MOUSEMOTION:
-                on_mouse_move({event.motion.x, event.motion.y, event.motion.xrel, event.motion.yrel});
-                break;
-            case SDL_KEYUP:
-                switch (event.key.keysym.sym) {
-                case SDLK_SPACE:
-                    on_key(key_event::SPACE_UP);
-                    break;
-                case SDLK_QUOTE:
-                    on_key(key_event::APOSTROPHE_UP);
-                    break;
-                case SDLK_COMMA:
-                    on_key(key_event::COMMA_UP);
-                    break;
-                case SDLK_MINUS:
-                    on_key(key_event::MINUS_UP);
-                    break;
-                case SDLK_PERIOD:
-                    on_key(key_event::PERIOD_UP);
-                    break;
-                case SDLK_SLASH:
-                    on_key(key_event::FORWARD_SLASH_UP);
-                    break;
-                case SDLK_0:
-                    on_key(key_event::ZERO_UP);
-                    break;
-                case SDLK_1:
-                    on_key(key_event::ONE_UP);
-                    break;
-                case SDLK_2:
-                    on_key(key_event::TWO_UP);
-                    break;
-                case SDLK_3:
-                    on_key(key_event::THREE_UP);
-                    break;
-                case SDLK_4:
-                    on_key(key_event::FOUR_UP);
-                    break;
-                case SDLK_5:
-                    on_key(key_event::FIVE_UP);
-                    break;
-                case SDLK_6:
-                    on_key(key_event::SIX_UP);
-                    break;
-                case SDLK_7:
-                    on_key(key_event::SEVEN_UP);
-                    break;
-                case SDLK_8:
-                    on_key(key_event::EIGHT_UP);
-                    break;
-                case SDLK_9:
-                    on_key(key_event::NINE_UP);
-                    break;
-                case SDLK_SEMICOLON:
-                    on_key(key_event::SEMICOLON_UP);
-                    break;
-                case SDLK_EQUALS:
-                    on_key(key_event::EQUAL_UP);
-                    break;
-                case SDLK_a:
-                    on_key(key_event::A_UP);
-                    break;
-                case SDLK_b:
-                    on_key(key_event::B_UP);
-                    break;
-                case SDLK_c:
-                    on_key(key_event::C_UP);
-                    break;
-                case SDLK_d:
-                    on_key(key_event::D_UP);
-                    break;
-                case SDLK_e:
-                    on_key(key_event::E_UP);
-                    break;
-                case SDLK_f:
-                    on_key(key_event::F_UP);
-                    break;
-                case SDLK_g:
-                    on_key(key_event::G_UP);
-                    break;
-                case SDLK_h:
-                    on_key(key_event::H_UP);
-                    break;
-                case SDLK_i:
-                    on_key(key_event::I_UP);
-                    break;
-                case SDLK_j:
-                    on_key(key_event::J_UP);
-                    break;
-                case SDLK_k:
-                    on_key(key_event::K_UP);
-                    break;
-                case SDLK_l:
-                    on_key(key_event::L_UP);
-                    break;
-                case SDLK_m:
-                    on_key(key_event::M_UP);
-                    break;
-                case SDLK_n:
-                    on_key(key_event::N_UP);
-                    break;
-                case SDLK_o:
-                    on_key(key_event::O_UP);
-                    break;
-                case SDLK_p:
-                    on_key(key_event::P_UP);
-                    break;
-                case SDLK_q:
-                    on_key(key_event::Q_UP);
-                    break;
-                case SDLK_r:
-                    on_key(key_event::R_UP);
-                    break;
-                case SDLK_s:
-                    on_key(key_event::S_UP);
-                    break;
-                case SDLK_t:
-                    on_key(key_event::T_UP);
-                    break;
-                case SDLK_u:
-                    on_key(key_event::U_UP);
-                    break;
-                case SDLK_v:
-                    on_key(key_event::V_UP);
-                    break;
-                case SDLK_w:
-                    on_key(key_event::W_UP);
-                    break;
-                case SDLK_x:
-                    on_key(key_event::X_UP);
-                    break;
-                case SDLK_y:
-                    on_key(key_event::Y_UP);
-                    break;
-                case SDLK_z:
-                    on_key(key_event::Z_UP);
-                    break;
-                case SDLK_LEFTBRACKET:
-                    on_key(key_event::LEFT_BRACKET_UP);
-                    break;
-                case SDLK_RIGHTBRACKET:
-                    on_key(key_event::RIGHT_BRACKET_UP);
-                    break;
-                case SDLK_BACKQUOTE:
-                    on_key(key_event::GRAVE_ACCENT_UP);
-                    break;
-                case SDLK_ESCAPE:
-                    on_key(key_event::ESCAPE_UP);
-                    break;
-                case SDLK_RETURN:
-                    on_key(key_event::ENTER_UP);
-                    break;
-                case SDLK_TAB:
-                    on_key(key_event::TAB_UP);
-                    break;
-                case SDLK_BACKSPACE:
-                    on_key(key_event::BACKSPACE_UP);
-                    break;
-                case SDLK_INSERT:
-                    on_key(key_event::INSERT_UP);
-                    break;
-                case SDLK_DELETE:
-                    on_key(key_event::DELETE_UP);
-                    break;
-                case SDLK_LEFT:
-                    on_key(key_event::LEFT_UP);
-                    break;
-                case SDLK_RIGHT:
-                    on_key(key_event::RIGHT_UP);
-                    break;
-                case SDLK_UP:
-                    on_key(key_event::UP_UP);
-                    break;
-                case SDLK_DOWN:
-                    on_key(key_event::DOWN_UP);
-                    break;
-                case SDLK_PAGEUP:
-                    on_key(key_event::PAGE_UP_UP);
-                    break;
-                case SDLK_PAGEDOWN:
-                    on_key(key_event::PAGE_DOWN_UP);
-                    break;
-                case SDLK_HOME:
-                    on_key(key_event::HOME_UP);
-                    break;
-                case SDLK_END:
-                    on_key(key_event::END_UP);
-                    break;
-                case SDLK_CAPSLOCK:
-                    on_key(key_event::CAPS_LOCK_UP);
-                    break;
-                case SDLK_SCROLLLOCK:
-                    on_key(key_event::SCROLL_LOCK_UP);
-                    break;
-                case SDLK_NUMLOCKCLEAR:
-                    on_key(key_event::NUM_LOCK_UP);
-                    break;
-                case SDLK_PRINTSCREEN:
-                    on_key(key_event::PRINT_SCREEN_UP);
-                    break;
-                case SDLK_PAUSE:
-                    on_key(key_event::PAUSE_UP);
-                    break;
-                case SDLK_F1:
-                    on_key(key_event::F1_UP);
-                    break;
-                case SDLK_F2:
-                    on_key(key_event::F2_UP);
-                    break;
-                case SDLK_F3:
-                    on_key(key_event::F3_UP);
-                    break;
-                case SDLK_F4:
-                    on_key(key_event::F4_UP);
-                    break;
-                case SDLK_F5:
-                    on_key(key_event::F5_UP);
-                    break;
-                case SDLK_F6:
-                    on_key(key_event::F6_UP);
-                    break;
-                case SDLK_F7:
-                    on_key(key_event::F7_UP);
-                    break;
-                case SDLK_F8:
-                    on_key(key_event::F8_UP);
-                    break;
-                case SDLK_F9:
-                    on_key(key_event::F9_UP);
-                    break;
-                case SDLK_F10:
-                    on_key(key_event::F10_UP);
-                    break;
-                case SDLK_F11:
-                    on_key(key_event::F11_UP);
-                    break;
-                case SDLK_F12:
-                    on_key(key_event::F12_UP);
-                    break;
-                case SDLK_KP_0:
-                    on_key(key_event::KEY_PAD_0_UP);
-                    break;
-                case SDLK_KP_1:
-                    on_key(key_event::KEY_PAD_1_UP);
-                    break;
-                case SDLK_KP_2:
-                    on_key(key_event::KEY_PAD_2_UP);
-                    break;
-                case SDLK_KP_3:
-                    on_key(key_event::KEY_PAD_3_UP);
-                    break;
-                case SDLK_KP_4:
-                    on_key(key_event::KEY_PAD_4_UP);
-                    break;
-                case SDLK_KP_5:
-                    on_key(key_event::KEY_PAD_5_UP);
-                    break;
-                case SDLK_KP_6:
-                    on_key(key_event::KEY_PAD_6_UP);
-                    break;
-                case SDLK_KP_7:
-                    on_key(key_event::KEY_PAD_7_UP);
-                    break;
-                case SDLK_KP_8:
-                    on_key(key_event::KEY_PAD_8_UP);
-                    break;
-                case SDLK_KP_9:
-                    on_key(key_event::KEY_PAD_9_UP);
-                    break;
-                case SDLK_KP_DECIMAL:
-                    on_key(key_event::KEY_PAD_DECIMAL_UP);
-                    break;
-                case SDLK_KP_DIVIDE:
-                    on_key(key_event::KEY_PAD_DIVIDE_UP);
-                    break;
-                case SDLK_KP_MULTIPLY:
-                    on_key(key_event::KEY_PAD_MULTIPLY_UP);
-                    break;
-                case SDLK_KP_MINUS:
-                    on_key(key_event::KEY_PAD_SUBTRACT_UP);
-                    break;
-                case SDLK_KP_PLUS:
-                    on_key(key_event::KEY_PAD_ADD_UP);
-                    break;
-                case SDLK_KP_ENTER:
-                    on_key(key_event::KEY_PAD_ENTER_UP);
-                    break;
-                case SDLK_KP_EQUALS:
-                    on_key(key_event::KEY_PAD_EQUAL_UP);
-                    break;
-                case SDLK_LSHIFT:
-                    on_key(key_event::LEFT_SHIFT_UP);
-                    break;
-                case SDLK_LCTRL:
-                    on_key(key_event::LEFT_CONTROL_UP);
-                    break;
-                case SDLK_LALT:
-                    on_key(key_event::LEFT_ALT_UP);
-                    break;
-                case SDLK_LGUI:
-                    on_key(key_event::LEFT_SUPER_UP);
-                    break;
-                case SDLK_RSHIFT:
-                    on_key(key_event::RIGHT_SHIFT_UP);
-                    break;
-                case SDLK_RCTRL:
-                    on_key(key_event::RIGHT_CONTROL_UP);
-                    break;
-                case SDLK_RALT:
-                    on_key(key_event::RIGHT_ALT_UP);
-                    break;
-                case SDLK_RGUI:
-                    on_key(key_event::RIGHT_SUPER_UP);
-                    break;
-                case SDLK_MENU:
-                    on_key(key_event::MENU_UP);
-                    break;
-                default:
-                    break;
-                }
-                break;
-            case SDL_KEYDOWN:
-                switch (event.key.keysym.sym) {
-                case SDLK_SPACE:
-                    on_key(key_event::SPACE_DOWN);
-                    break;
-                case SDLK_QUOTE:
-                    on_key(key_event::APOSTROPHE_DOWN);
-                    break;
-                case SDLK_COMMA:
-                    on_key(key_event::COMMA_DOWN);
-                    break;
-                case SDLK_MINUS:
-                    on_key(key_event::MINUS_DOWN);
-                    break;
-                case SDLK_PERIOD:
-                    on_key(key_event::PERIOD_DOWN);
-                    break;
-                case SDLK_SLASH:
-                    on_key(key_event::FORWARD_SLASH_DOWN);
-                    break;
-                case SDLK_0:
-                    on_key(key_event::ZERO_DOWN);
-                    break;
-                case SDLK_1:
-                    on_key(key_event::ONE_DOWN);
-                    break;
-                case SDLK_2:
-                    on_key(key_event::TWO_DOWN);
-                    break;
-                case SDLK_3:
-                    on_key(key_event::THREE_DOWN);
-                    break;
-                case SDLK_4:
-                    on_key(key_event::FOUR_DOWN);
-                    break;
-                case SDLK_5:
-                    on_key(key_event::FIVE_DOWN);
-                    break;
-                case SDLK_6:
-                    on_key(key_event::SIX_DOWN);
-                    break;
-                case SDLK_7:
-                    on_key(key_event::SEVEN_DOWN);
-                    break;
-                case SDLK_8:
-                    on_key(key_event::EIGHT_DOWN);
-                    break;
-                case SDLK_9:
-                    on_key(key_event::NINE_DOWN);
-                    break;
-                case SDLK_SEMICOLON:
-                    on_key(key_event::SEMICOLON_DOWN);
-                    break;
-                case SDLK_EQUALS:
-                    on_key(key_event::EQUAL_DOWN);
-                    break;
-                case SDLK_a:
-                    on_key(key_event::A_DOWN);
-                    break;
-                case SDLK_b:
-                    on_key(key_event::B_DOWN);
-                    break;
-                case SDLK_c:
-                    on_key(key_event::C_DOWN);
-                    break;
-                case SDLK_d:
-                    on_key(key_event::D_DOWN);
-                    break;
-                case SDLK_e:
-                    on_key(key_event::E_DOWN);
-                    break;
-                case SDLK_f:
-                    on_key(key_event::F_DOWN);
-                    break;
-                case SDLK_g:
-                    on_key(key_event::G_DOWN);
-                    break;
-                case SDLK_h:
-                    on_key(key_event::H_DOWN);
-                    break;
-                case SDLK_i:
-                    on_key(key_event::I_DOWN);
-                    break;
-                case SDLK_j:
-                    on_key(key_event::J_DOWN);
-                    break;
-                case SDLK_k:
-                    on_key(key_event::K_DOWN);
-                    break;
-                case SDLK_l:
-                    on_key(key_event::L_DOWN);
-                    break;
-                case SDLK_m:
-                    on_key(key_event::M_DOWN);
-                    break;
-                case SDLK_n:
-                    on_key(key_event::N_DOWN);
-                    break;
-                case SDLK_o:
-                    on_key(key_event::O_DOWN);
-                    break;
-                case SDLK_p:
-                    on_key(key_event::P_DOWN);
-                    break;
-                case SDLK_q:
-                    on_key(key_event::Q_DOWN);
-                    break;
-                case SDLK_r:
-                    on_key(key_event::R_DOWN);
-                    break;
-                case SDLK_s:
-                    on_key(key_event::S_DOWN);
-                    break;
-                case SDLK_t:
-                    on_key(key_event::T_DOWN);
-                    break;
-                case SDLK_u:
-                    on_key(key_event::U_DOWN);
-                    break;
-                case SDLK_v:
-                    on_key(key_event::V_DOWN);
-                    break;
-                case SDLK_w:
-                    on_key(key_event::W_DOWN);
-                    break;
-                case SDLK_x:
-                    on_key(key_event::X_DOWN);
-                    break;
-                case SDLK_y:
-                    on_key(key_event::Y_DOWN);
-                    break;
-                case SDLK_z:
-                    on_key(key_event::Z_DOWN);
-                    break;
-                case SDLK_LEFTBRACKET:
-                    on_key(key_event::LEFT_BRACKET_DOWN);
-                    break;
-                case SDLK_RIGHTBRACKET:
-                    on_key(key_event::RIGHT_BRACKET_DOWN);
-                    break;
-                case SDLK_BACKQUOTE:
-                    on_key(key_event::GRAVE_ACCENT_DOWN);
-                    break;
-                case SDLK_ESCAPE:
-                    on_key(key_event::ESCAPE_DOWN);
-                    break;
-                case SDLK_RETURN:
-                    on_key(key_event::ENTER_DOWN);
-                    break;
-                case SDLK_TAB:
-                    on_key(key_event::TAB_DOWN);
-                    break;
-                case SDLK_BACKSPACE:
-                    on_key(key_event::BACKSPACE_DOWN);
-                    break;
-                case SDLK_INSERT:
-                    on_key(key_event::INSERT_DOWN);
-                    break;
-                case SDLK_DELETE:
-                    on_key(key_event::DELETE_DOWN);
-                    break;
-                case SDLK_LEFT:
-                    on_key(key_event::LEFT_DOWN);
-                    break;
-                case SDLK_RIGHT:
-                    on_key(key_event::RIGHT_DOWN);
-                    break;
-                case SDLK_UP:
-                    on_key(key_event::UP_DOWN);
-                    break;
-                case SDLK_DOWN:
-                    on_key(key_event::DOWN_DOWN);
-                    break;
-                case SDLK_PAGEUP:
-                    on_key(key_event::PAGE_UP_DOWN);
-                    break;
-                case SDLK_PAGEDOWN:
-                    on_key(key_event::PAGE_DOWN_DOWN);
-                    break;
-                case SDLK_HOME:
-                    on_key(key_event::HOME_DOWN);
-                    break;
-                case SDLK_END:
-                    on_key(key_event::END_DOWN);
-                    break;
-                case SDLK_CAPSLOCK:
-                    on_key(key_event::CAPS_LOCK_DOWN);
-                    break;
-                case SDLK_SCROLLLOCK:
-                    on_key(key_event::SCROLL_LOCK_DOWN);
-                    break;
-                case SDLK_NUMLOCKCLEAR:
-                    on_key(key_event::NUM_LOCK_DOWN);
-                    break;
-                case SDLK_PRINTSCREEN:
-                    on_key(key_event::PRINT_SCREEN_DOWN);
-                    break;
-                case SDLK_PAUSE:
-                    on_key(key_event::PAUSE_DOWN);
-                    break;
-                case SDLK_F1:
-                    on_key(key_event::F1_DOWN);
-                    break;
-                case SDLK_F2:
-                    on_key(key_event::F2_DOWN);
-                    break;
-                case SDLK_F3:
-                    on_key(key_event::F3_DOWN);
-                    break;
-                case SDLK_F4:
-                    on_key(key_event::F4_DOWN);
-                    break;
-                case SDLK_F5:
-                    on_key(key_event::F5_DOWN);
-                    break;
-                case SDLK_F6:
-                    on_key(key_event::F6_DOWN);
-                    break;
-                case SDLK_F7:
-                    on_key(key_event::F7_DOWN);
-                    break;
-                case SDLK_F8:
-                    on_key(key_event::F8_DOWN);
-                    break;
-                case SDLK_F9:
-                    on_key(key_event::F9_DOWN);
-                    break;
-                case SDLK_F10:
-                    on_key(key_event::F10_DOWN);
-                    break;
-                case SDLK_F11:
-                    on_key(key_event::F11_DOWN);
-                    break;
-                case SDLK_F12:
-                    on_key(key_event::F12_DOWN);
-                    break;
-                case SDLK_KP_0:
-                    on_key(key_event::KEY_PAD_0_DOWN);
-                    break;
-                case SDLK_KP_1:
-                    on_key(key_event::KEY_PAD_1_DOWN);
-                    break;
-                case SDLK_KP_2:
-                    on_key(key_event::KEY_PAD_2_DOWN);
-                    break;
-                case SDLK_KP_3:
-                    on_key(key_event::KEY_PAD_3_DOWN);
-                    break;
-                case SDLK_KP_4:
-                    on_key(key_event::KEY_PAD_4_DOWN);
-                    break;
-                case SDLK_KP_5:
-                    on_key(key_event::KEY_PAD_5_DOWN);
-                    break;
-                case SDLK_KP_6:
-                    on_key(key_event::KEY_PAD_6_DOWN);
-                    break;
-                case SDLK_KP_7:
-                    on_key(key_event::KEY_PAD_7_DOWN);
-                    break;
-                case SDLK_KP_8:
-                    on_key(key_event::KEY_PAD_8_DOWN);
-                    break;
-                case SDLK_KP_9:
-                    on_key(key_event::KEY_PAD_9_DOWN);
-                    break;
-                case SDLK_KP_DECIMAL:
-                    on_key(key_event::KEY_PAD_DECIMAL_DOWN);
-                    break;
-                case SDLK_KP_DIVIDE:
-                    on_key(key_event::KEY_PAD_DIVIDE_DOWN);
-                    break;
-                case SDLK_KP_MULTIPLY:
-                    on_key(key_event::KEY_PAD_MULTIPLY_DOWN);
-                    break;
-                case SDLK_KP_MINUS:
-                    on_key(key_event::KEY_PAD_SUBTRACT_DOWN);
-                    break;
-                case SDLK_KP_PLUS:
-                    on_key(key_event::KEY_PAD_ADD_DOWN);
-                    break;
-                case SDLK_KP_ENTER:
-                    on_key(key_event::KEY_PAD_ENTER_DOWN);
-                    break;
-                case SDLK_KP_EQUALS:
-                    on_key(key_event::KEY_PAD_EQUAL_DOWN);
-                    break;
-                case SDLK_LSHIFT:
-                    on_key(key_event::LEFT_SHIFT_DOWN);
-                    break;
-                case SDLK_LCTRL:
-                    on_key(key_event::LEFT_CONTROL_DOWN);
-                    break;
-                case SDLK_LALT:
-                    on_key(key_event::LEFT_ALT_DOWN);
-                    break;
-                case SDLK_LGUI:
-                    on_key(key_event::LEFT_SUPER_DOWN);
-                    break;
-                case SDLK_RSHIFT:
-                    on_key(key_event::RIGHT_SHIFT_DOWN);
-                    break;
-                case SDLK_RCTRL:
-                    on_key(key_event::RIGHT_CONTROL_DOWN);
-                    break;
-                case SDLK_RALT:
-                    on_key(key_event::RIGHT_ALT_DOWN);
-                    break;
-                case SDLK_RGUI:
-                    on_key(key_event::RIGHT_SUPER_DOWN);
-                    break;
-                case SDLK_MENU:
-                    on_key(key_event::MENU_DOWN);
-                    break;
-                default:
-                    break;
-                }
-                break;
-            case SDL_QUIT:
-                destroy();
-            default:
-                break;
+        if (event.type == wake_event || event.type == SDL_QUIT) {
+            for (auto &[id, window_inbox] : inboxes) {
+                window_inbox->push(event);
             }
-        } else {
-            unhandled_events.push_back(event);
+        } else if (auto it = inboxes.find(event.window.windowID); it != inboxes.end()) {
+            it->second->push(event);
         }
     }
-    for (auto &e : unhandled_events) {
-        SDL_PushEvent(&e);
+}
+void sdl_gl_renderer::handle_event(const SDL_Event &event) {
+    switch (event.type) {
+    case SDL_WINDOWEVENT:
+        switch (event.window.event) {
+        case SDL_WINDOWEVENT_CLOSE:
+            destroy();
+            break;
+        case SDL_WINDOWEVENT_EXPOSED:
+            request_redraw();
+            break;
+        case SDL_WINDOWEVENT_SHOWN:
+        case SDL_WINDOWEVENT_RESTORED:
+        case SDL_WINDOWEVENT_MAXIMIZED:
+            set_visible(true);
+            break;
+        case SDL_WINDOWEVENT_HIDDEN:
+        case SDL_WINDOWEVENT_MINIMIZED:
+            set_visible(false);
+            break;
+        case SDL_WINDOWEVENT_RESIZED:
+            // properties.window_width = static_cast<uint64_t>(event.window.data1);
+            // properties.window_height = static_cast<uint64_t>(event.window.data2);
+            // high DPI monitors will not report actual pixels, so we get them this way
+            int w, h;
+            SDL_GL_GetDrawableSize(window, &w, &h);
+            properties.window_width = w;
+            properties.window_height = h;
+            on_resize({properties.window_width, properties.window_height});
+            break;
+        default:
+            break;
+        }
+        break;
+    case SDL_MOUSEBUTTONUP:
+        switch (event.button.button) {
+        case SDL_BUTTON_LEFT:
+            on_mouse_button(mouse_button_event::LEFT_MOUSE_UP);
+            break;
+        case SDL_BUTTON_RIGHT:
+            on_mouse_button(mouse_button_event::RIGHT_MOUSE_UP);
+            break;
+        case SDL_BUTTON_MIDDLE:
+            on_mouse_button(mouse_button_event::MIDDLE_MOUSE_UP);
+            break;
+        default:
+            break;
+        }
+        break;
+    case SDL_MOUSEBUTTONDOWN:
+        switch (event.button.button) {
+        case SDL_BUTTON_LEFT:
+            on_mouse_button(mouse_button_event::LEFT_MOUSE_DOWN);
+            break;
+        case SDL_BUTTON_RIGHT:
+            on_mouse_button(mouse_button_event::RIGHT_MOUSE_DOWN);
+            break;
+        case SDL_BUTTON_MIDDLE:
+            on_mouse_button(mouse_button_event::MIDDLE_MOUSE_DOWN);
+            break;
+        default:
+            break;
+        }
+        break;
+    case SDL_MOUSEWHEEL:
+        on_mouse_wheel({event.wheel.preciseX, event.wheel.preciseY});
+        break;
+    case SDL_MOUSEMOTION:
+        on_mouse_move({event.motion.x, event.motion.y, event.motion.xrel, event.motion.yrel});
+        break;
+    case SDL_KEYUP:
+        if (auto down = sdl_gl_keys.down_event(event.key.keysym.sym)) {
+            on_key(key_up_event(*down));
+        }
+        break;
+    case SDL_KEYDOWN:
+        if (auto down = sdl_gl_keys.down_event(event.key.keysym.sym)) {
+            on_key(*down);
+        }
+        break;
+    case SDL_QUIT:
+        destroy();
+    default:
+        break;
+    }
+}
+sdl_gl_shared_objects::~sdl_gl_shared_objects() {
+    // shaders may outlive the context, so the programs still referenced by them are deleted here
+    for (const auto &[key, weak_program] : program_cache) {
+        if (auto program = weak_program.lock()) {
+            program->release();
+        }
+    }
+    texture_loader.reset();
+    for (const auto &[settings, sampler] : sampler_cache) {
+        glDeleteSamplers(1, &sampler);
     }
 }
 void sdl_gl_renderer::destroy_context() {
-    for (const auto &[name, program] : shader_name_binding_cache) {
-        glDeleteProgram(program);
+    gpu_timer.reset();
+    frame_timer.reset();
+    scene_target.reset();
+    // the last renderer of the group deletes the shared objects while its context is still current
+    if (shared) {
+        std::erase(shared->renderers, this);
+        shared.reset();
+    }
+    resources.reset();
+    if (default_framebuffer) {
+        glDeleteFramebuffers(1, &default_framebuffer);
+        glDeleteRenderbuffers(1, &color_renderbuffer);
+        glDeleteRenderbuffers(1, &depth_renderbuffer);
+        default_framebuffer = color_renderbuffer = depth_renderbuffer = 0;
     }
+    for (GLsync fence : frame_fences) {
+        glDeleteSync(fence);
+    }
+    frame_fences.clear();
     SDL_GL_DeleteContext(glcontext);
     SDL_DestroyWindow(window);
+    inboxes.erase(window_id);
 }
 void sdl_gl_renderer::activate_context() { SDL_GL_MakeCurrent(window, glcontext); }
-void sdl_gl_renderer::swap_buffers() { SDL_GL_SwapWindow(window); }
+void sdl_gl_renderer::release_context() { SDL_GL_MakeCurrent(window, nullptr); }
+void sdl_gl_renderer::begin_frame() {
+    // wait before the events are polled so the frame is rendered from the newest input
+    if (frame_fences.size() > frames_in_flight_limit()) {
+        profile_zone zone("wait_frames_in_flight");
+        while (frame_fences.size() > frames_in_flight_limit()) {
+            glClientWaitSync(frame_fences.front(), GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(frame_fences.front());
+            frame_fences.pop_front();
+        }
+    }
+    if (gpu_timer) {
+        gpu_timer->collect();
+    }
+    int64_t gpu_time_ns = 0;
+    while (frame_timer->next_result(gpu_time_ns)) {
+        record_gpu_time(gpu_time_ns);
+    }
+    profile_zone zone("texture_uploads");
+    if (shared->texture_loader->process_uploads(properties.texture_upload_budget) > 0 && shared->renderers.size() > 1) {
+        // other contexts of the group only see the texture data once the upload has completed
+        glFinish();
+    }
+}
+void sdl_gl_renderer::begin_render() {
+    frame_timer->begin();
+    if (!properties.dynamic_resolution) {
+        return;
+    }
+    float max_scale = std::max(properties.max_resolution_scale, properties.min_resolution_scale);
+    auto target_width = static_cast<uint32_t>(std::ceil(properties.window_width * max_scale));
+    auto target_height = static_cast<uint32_t>(std::ceil(properties.window_height * max_scale));
+    if (!scene_target || scene_target->get_width() != target_width || scene_target->get_height() != target_height) {
+        scene_target = std::make_unique<sdl_gl_render_target>(target_width, target_height, properties.samples, true);
+    }
+    float scale = get_resolution_scale();
+    scene_width = std::clamp(static_cast<uint32_t>(std::lround(properties.window_width * scale)), 1u, target_width);
+    scene_height = std::clamp(static_cast<uint32_t>(std::lround(properties.window_height * scale)), 1u, target_height);
+    scene_target_bound = true;
+    bind_render_target(nullptr);
+}
+void sdl_gl_renderer::end_render() {
+    if (scene_target_bound) {
+        scene_target_bound = false;
+        present_render_target(scene_target.get(), scene_width, scene_height);
+        bind_render_target(nullptr);
+    }
+    frame_timer->end();
+}
+GLuint sdl_gl_renderer::frame_framebuffer() const {
+    return scene_target_bound ? scene_target->get_framebuffer() : default_framebuffer;
+}
+uint32_t sdl_gl_renderer::frame_width() const {
+    return scene_target_bound ? scene_width : static_cast<uint32_t>(properties.window_width);
+}
+uint32_t sdl_gl_renderer::frame_height() const {
+    return scene_target_bound ? scene_height : static_cast<uint32_t>(properties.window_height);
+}
+void sdl_gl_renderer::begin_gpu_zone(const char *name) {
+    if (gpu_timer) {
+        gpu_timer->begin(name);
+    }
+}
+void sdl_gl_renderer::end_gpu_zone() {
+    if (gpu_timer) {
+        gpu_timer->end();
+    }
+}
+void sdl_gl_renderer::swap_buffers() {
+    if (!properties.headless) {
+        SDL_GL_SwapWindow(window);
+    }
+    if (frames_in_flight_limit() > 0) {
+        frame_fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        glFlush();
+    }
+}
+size_t sdl_gl_renderer::frames_in_flight_limit() const {
+    if (properties.max_frames_in_flight > 0) {
+        return static_cast<size_t>(properties.max_frames_in_flight);
+    }
+    // Without a swap chain nothing throttles the CPU, so like a double buffered swap chain at most one frame is queued
+    // while the next one is recorded.
+    return properties.headless ? 1 : 0;
+}
 
 void sdl_gl_renderer::clear_color_buffer(squint::fvec4 color) {
     glClearColor(color[0], color[1], color[2], color[3]);
@@ -1212,28 +1369,29 @@ void sdl_gl_renderer::enable_blending(bool enable) {
     }
 }
 std::unique_ptr<shader> sdl_gl_renderer::gen_shader(const std::string &name,
-                                                    const std::filesystem::path &shader_src_directory) {
-    // There is no need to recompile the shader if it has already been compiled, so we just construct it from the
-    // existing program id
-    if (shader_name_binding_cache.find(name) == shader_name_binding_cache.end()) {
-        auto new_shader = std::make_unique<sdl_gl_shader>(shader_src_directory);
-        shader_name_binding_cache[name] = new_shader->get_id();
-        return new_shader;
-    } else {
-        return std::make_unique<sdl_gl_shader>(shader_name_binding_cache[name]);
-    }
+                                                    const std::filesystem::path &shader_src_directory,
+                                                    const std::vector<std::string> &defines) {
+    return gen_shader(name, sdl_gl_program::read_sources(shader_src_directory), defines);
 }
 std::unique_ptr<shader> sdl_gl_renderer::gen_shader(const std::string &name,
-                                                    const std::vector<shader_src> &shader_sources) {
-    // There is no need to recompile the shader if it has already been compiled, so we just construct it from the
-    // existing program id
-    if (shader_name_binding_cache.find(name) == shader_name_binding_cache.end()) {
-        auto new_shader = std::make_unique<sdl_gl_shader>(shader_sources);
-        shader_name_binding_cache[name] = new_shader->get_id();
-        return new_shader;
-    } else {
-        return std::make_unique<sdl_gl_shader>(shader_name_binding_cache[name]);
+                                                    const std::vector<shader_src> &shader_sources,
+                                                    const std::vector<std::string> &defines) {
+    // There is no need to recompile the shader if a program has already been linked from the same sources, so we
+    // just construct it from the existing program
+    auto sources = sdl_gl_program::apply_defines(shader_sources, defines);
+    size_t key = sdl_gl_program::hash_sources(sources);
+    auto &program_cache = shared->program_cache;
+    auto [first, last] = program_cache.equal_range(key);
+    for (auto it = first; it != last; it++) {
+        if (auto program = it->second.lock(); program && program->has_sources(sources)) {
+            return std::make_unique<sdl_gl_shader>(std::move(program));
+        }
     }
+    // drop the programs that are no longer referenced by any shader
+    std::erase_if(program_cache, [](const auto &entry) { return entry.second.expired(); });
+    auto program = std::make_shared<sdl_gl_program>(sources, name);
+    program_cache.emplace(key, program);
+    return std::make_unique<sdl_gl_shader>(std::move(program));
 }
 std::unique_ptr<buffer> sdl_gl_renderer::gen_buffer(const void *data, const size_t size_in_bytes,
                                                     const buffer_format &format, const buffer_access_type type) {
@@ -1242,44 +1400,147 @@ std::unique_ptr<buffer> sdl_gl_renderer::gen_buffer(const void *data, const size
 std::unique_ptr<texture2D> sdl_gl_renderer::gen_texture(const std::filesystem::path &image_filepath) {
     return std::make_unique<sdl_gl_texture2D>(image_filepath);
 }
+std::shared_ptr<texture2D> sdl_gl_renderer::load_texture(const std::filesystem::path &image_filepath) {
+    return shared->texture_loader->load(image_filepath);
+}
+std::unique_ptr<texture2D_array>
+sdl_gl_renderer::gen_texture_array(const std::vector<std::filesystem::path> &image_filepaths, texture_packing packing) {
+    return std::make_unique<sdl_gl_texture2D_array>(image_filepaths, packing, properties.texture_atlas_size);
+}
 std::unique_ptr<vertex_input_assembly> sdl_gl_renderer::gen_vertex_input_assembly(index_type type) {
     return std::make_unique<sdl_gl_vertex_input_assembly>(type);
 }
 void sdl_gl_renderer::draw_mesh(const simple_mesh *m, const transform *model, material *mat) {
+    profile_zone zone("draw_mesh");
     const vertex_input_assembly *input_assembly = m->get_input_assembly();
     if (input_assembly) {
         input_assembly->activate();
         mat->set_model(model);
+        size_t vertex_count = input_assembly->get_index_buffer() ? input_assembly->get_index_buffer()->count()
+                                                                 : input_assembly->get_vertex_buffers()[0]->count();
         if (input_assembly->get_index_buffer()) {
-            glDrawElements(gl_draw_method(m->get_draw_method()),
-                           static_cast<GLsizei>(input_assembly->get_index_buffer()->count()),
+            glDrawElements(gl_draw_method(m->get_draw_method()), static_cast<GLsizei>(vertex_count),
                            gl_index_type(input_assembly->get_index_type()), nullptr);
         } else {
-            glDrawArrays(gl_draw_method(m->get_draw_method()), 0,
-                         static_cast<GLsizei>(input_assembly->get_vertex_buffers()[0]->count()));
+            glDrawArrays(gl_draw_method(m->get_draw_method()), 0, static_cast<GLsizei>(vertex_count));
         }
+        render_stats &stats = get_frame_stats();
+        stats.draw_calls++;
+        stats.primitives += primitive_count(m->get_draw_method(), vertex_count);
     }
 }
 void sdl_gl_renderer::draw_mesh(const instanced_mesh *m, const transform *model, material *mat,
                                 unsigned int instance_count) {
+    profile_zone zone("draw_mesh_instanced");
     const vertex_input_assembly *input_assembly = m->get_input_assembly();
     if (input_assembly) {
         input_assembly->activate();
         mat->set_model(model);
         mat->get_shader()->upload_storage_buffer("model_instances", m->get_transform_buffer());
+        size_t vertex_count = input_assembly->get_index_buffer() ? input_assembly->get_index_buffer()->count()
+                                                                 : input_assembly->get_vertex_buffers()[0]->count();
         if (input_assembly->get_index_buffer()) {
-            glDrawElementsInstancedBaseVertex(
-                gl_draw_method(m->get_draw_method()), static_cast<GLsizei>(input_assembly->get_index_buffer()->count()),
-                gl_index_type(input_assembly->get_index_type()), nullptr, m->get_instance_count(), 0);
+            glDrawElementsInstancedBaseVertex(gl_draw_method(m->get_draw_method()), static_cast<GLsizei>(vertex_count),
+                                              gl_index_type(input_assembly->get_index_type()), nullptr,
+                                              m->get_instance_count(), 0);
         } else {
-            glDrawArraysInstanced(gl_draw_method(m->get_draw_method()), 0,
-                                  static_cast<GLsizei>(input_assembly->get_vertex_buffers()[0]->count()),
+            glDrawArraysInstanced(gl_draw_method(m->get_draw_method()), 0, static_cast<GLsizei>(vertex_count),
                                   m->get_instance_count());
         }
+        render_stats &stats = get_frame_stats();
+        stats.instanced_draw_calls++;
+        stats.instances += m->get_instance_count();
+        stats.primitives += primitive_count(m->get_draw_method(), vertex_count) * m->get_instance_count();
+        // unbind the transforms so later draws with the same shader don't read them as instances
+        GLint binding = static_cast<sdl_gl_shader *>(mat->get_shader())->storage_binding("model_instances");
+        if (binding != -1) {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(binding), 0);
+        }
     }
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
 }
 void sdl_gl_renderer::set_viewport(size_t x, size_t y, size_t width, size_t height) { glViewport(x, y, width, height); }
+std::unique_ptr<render_target> sdl_gl_renderer::gen_render_target(uint32_t width, uint32_t height, int samples,
+                                                                  bool depth) {
+    return std::make_unique<sdl_gl_render_target>(width, height, samples, depth);
+}
+void sdl_gl_renderer::bind_render_target(render_target *target) {
+    if (target) {
+        glBindFramebuffer(GL_FRAMEBUFFER, static_cast<sdl_gl_render_target *>(target)->get_framebuffer());
+        glViewport(0, 0, target->get_width(), target->get_height());
+    } else {
+        glBindFramebuffer(GL_FRAMEBUFFER, frame_framebuffer());
+        glViewport(0, 0, frame_width(), frame_height());
+    }
+}
+void sdl_gl_renderer::present_render_target(render_target *target, uint32_t width, uint32_t height,
+                                            texture_filter filter) {
+    auto gl_target = static_cast<sdl_gl_render_target *>(target);
+    width = std::min(width, target->get_width());
+    height = std::min(height, target->get_height());
+    gl_target->resolve(width, height);
+    glBlitNamedFramebuffer(gl_target->get_resolve_framebuffer(), frame_framebuffer(), 0, 0, width, height, 0, 0,
+                           frame_width(), frame_height(), GL_COLOR_BUFFER_BIT,
+                           filter == texture_filter::NEAREST ? GL_NEAREST : GL_LINEAR);
+}
+framebuffer_image sdl_gl_renderer::read_framebuffer() {
+    activate_context();
+    auto width = static_cast<GLsizei>(properties.window_width);
+    auto height = static_cast<GLsizei>(properties.window_height);
+    framebuffer_image image{static_cast<uint32_t>(width), static_cast<uint32_t>(height),
+                            std::vector<uint8_t>(static_cast<size_t>(width) * height * 4)};
+    GLuint source = default_framebuffer;
+    GLuint resolve_framebuffer = 0;
+    GLuint resolve_renderbuffer = 0;
+    GLint sample_buffers = 0;
+    glGetNamedFramebufferParameteriv(default_framebuffer, GL_SAMPLE_BUFFERS, &sample_buffers);
+    if (sample_buffers > 0) {
+        // multisampled framebuffers cannot be read directly so they are resolved first
+        glCreateRenderbuffers(1, &resolve_renderbuffer);
+        glNamedRenderbufferStorage(resolve_renderbuffer, GL_RGBA8, width, height);
+        glCreateFramebuffers(1, &resolve_framebuffer);
+        glNamedFramebufferRenderbuffer(resolve_framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                                       resolve_renderbuffer);
+        glNamedFramebufferReadBuffer(default_framebuffer, default_framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+        glBlitNamedFramebuffer(default_framebuffer, resolve_framebuffer, 0, 0, width, height, 0, 0, width, height,
+                               GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        source = resolve_framebuffer;
+    }
+    glNamedFramebufferReadBuffer(source, source ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, default_framebuffer);
+    glDeleteFramebuffers(1, &resolve_framebuffer);
+    glDeleteRenderbuffers(1, &resolve_renderbuffer);
+    // GL rows are ordered from bottom to top
+    size_t row_bytes = static_cast<size_t>(width) * 4;
+    for (size_t top = 0, bottom = image.height - 1; top < bottom; top++, bottom--) {
+        std::swap_ranges(image.pixels.begin() + top * row_bytes, image.pixels.begin() + (top + 1) * row_bytes,
+                         image.pixels.begin() + bottom * row_bytes);
+    }
+    return image;
+}
+GLuint sdl_gl_renderer::get_sampler(const sampler_settings &settings) {
+    auto &sampler_cache = shared->sampler_cache;
+    auto it = std::find_if(sampler_cache.begin(), sampler_cache.end(),
+                           [&settings](const auto &entry) { return entry.first == settings; });
+    if (it != sampler_cache.end()) {
+        return it->second;
+    }
+    GLuint sampler;
+    glCreateSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, gl_min_filter(settings.filter));
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, gl_mag_filter(settings.filter));
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, gl_wrap(settings.wrap));
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, gl_wrap(settings.wrap));
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, gl_wrap(settings.wrap));
+    if (max_anisotropy > 1.f) {
+        glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT,
+                            std::clamp(settings.anisotropy, 1.f, max_anisotropy));
+    }
+    sampler_cache.emplace_back(settings, sampler);
+    return sampler;
+}
 void sdl_gl_renderer::set_cursor(cursor_type type) {
     properties.cursor = type;
     SDL_SetRelativeMouseMode(SDL_FALSE);
@@ -1293,22 +1554,110 @@ void sdl_gl_renderer::set_cursor(cursor_type type) {
         break;
     }
 }
-sdl_gl_shader::sdl_gl_shader(const std::filesystem::path &shader_src_folder) {
+sdl_gl_program::sdl_gl_program(const std::vector<shader_src> &sources, const std::string &label)
+    : program(create_program(sources)), sources(sources) {
+    if (!label.empty()) {
+        glObjectLabel(GL_PROGRAM, program, static_cast<GLsizei>(label.size()), label.c_str());
+    }
+}
+void sdl_gl_program::release() {
+    glDeleteProgram(program);
+    program = 0;
+    uniform_location_cache.clear();
+    texture_binding_cache.clear();
+    storage_binding_cache.clear();
+}
+GLint sdl_gl_program::uniform_location(const std::string &name) {
+    auto it = uniform_location_cache.find(name);
+    if (it == uniform_location_cache.end()) {
+        // cache the location
+        it = uniform_location_cache.emplace(name, glGetProgramResourceLocation(program, GL_UNIFORM, name.c_str()))
+                 .first;
+    }
+    return it->second;
+}
+GLint sdl_gl_program::texture_unit(const std::string &name) {
+    auto it = texture_binding_cache.find(name);
+    if (it == texture_binding_cache.end()) {
+        // assign the next free texture unit to the sampler. The program must be active.
+        GLint location = uniform_location(name);
+        GLint unit = -1;
+        if (location != -1) {
+            unit = static_cast<GLint>(std::count_if(texture_binding_cache.begin(), texture_binding_cache.end(),
+                                                    [](const auto &binding) { return binding.second != -1; }));
+            glUniform1i(location, unit);
+        }
+        it = texture_binding_cache.emplace(name, unit).first;
+    }
+    return it->second;
+}
+GLint sdl_gl_program::storage_binding(const std::string &name) {
+    auto it = storage_binding_cache.find(name);
+    if (it == storage_binding_cache.end()) {
+        // use the binding point the shader declares for the block, so it doesn't depend on the order blocks are used in
+        GLuint index = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, name.c_str());
+        GLint binding = -1;
+        if (index != GL_INVALID_INDEX) {
+            const GLenum property = GL_BUFFER_BINDING;
+            glGetProgramResourceiv(program, GL_SHADER_STORAGE_BLOCK, index, 1, &property, 1, nullptr, &binding);
+        }
+        it = storage_binding_cache.emplace(name, binding).first;
+    }
+    return it->second;
+}
+std::vector<shader_src> sdl_gl_program::read_sources(const std::filesystem::path &shader_src_directory) {
+    // sort the files so the same directory always hashes to the same program
+    std::vector<std::filesystem::path> src_files{};
+    for (const auto &src_file : std::filesystem::directory_iterator(shader_src_directory)) {
+        src_files.push_back(src_file.path());
+    }
+    std::sort(src_files.begin(), src_files.end());
     std::vector<shader_src> sources{};
-    for (const auto &src_file : std::filesystem::directory_iterator(shader_src_folder)) {
+    for (const auto &src_file : src_files) {
         sources.push_back(read_shader(src_file));
     }
-    program = create_program(sources);
+    return sources;
 }
-sdl_gl_shader::sdl_gl_shader(const std::vector<shader_src> &shader_sources) {
-    program = create_program(shader_sources);
+std::vector<shader_src> sdl_gl_program::apply_defines(const std::vector<shader_src> &sources,
+                                                      const std::vector<std::string> &defines) {
+    if (defines.empty()) {
+        return sources;
+    }
+    std::string define_block{};
+    for (const auto &define : defines) {
+        define_block += "#define " + define + '\n';
+    }
+    std::vector<shader_src> result = sources;
+    for (auto &source : result) {
+        // the '#version' directive must come first so the defines are placed on the line after it
+        size_t version = source.src.find("#version");
+        if (version == std::string::npos) {
+            source.src.insert(0, define_block);
+        } else {
+            size_t line_end = source.src.find('\n', version);
+            if (line_end == std::string::npos) {
+                source.src += '\n' + define_block;
+            } else {
+                source.src.insert(line_end + 1, define_block);
+            }
+        }
+    }
+    return result;
 }
-sdl_gl_shader::~sdl_gl_shader() {
-    // program is deleted in destroy_context()
-    // glDeleteProgram(program); // Silently ignored if program is 0
+bool sdl_gl_program::has_sources(const std::vector<shader_src> &other) const {
+    return std::equal(sources.begin(), sources.end(), other.begin(), other.end(),
+                      [](const shader_src &a, const shader_src &b) { return a.type == b.type && a.src == b.src; });
 }
-void sdl_gl_shader::activate() { glUseProgram(program); }
-shader_src sdl_gl_shader::read_shader(const std::filesystem::path &shader_src_filepath) {
+size_t sdl_gl_program::hash_sources(const std::vector<shader_src> &sources) {
+    size_t seed = sources.size();
+    auto combine = [&seed](size_t h) { seed ^= h + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2); };
+    for (const auto &source : sources) {
+        combine(static_cast<size_t>(source.type));
+        combine(std::hash<std::string>{}(source.src));
+    }
+    return seed;
+}
+shader_src sdl_gl_program::read_shader(const std::filesystem::path &shader_src_filepath) {
     shader_src src{};
     src.type = shader_ext_type.at(shader_src_filepath.extension().string());
     std::ifstream s_file{shader_src_filepath};
@@ -1323,7 +1672,7 @@ shader_src sdl_gl_shader::read_shader(const std::filesystem::path &shader_src_fi
     }
     return src;
 }
-GLuint sdl_gl_shader::compile_shader(const shader_src &source) {
+GLuint sdl_gl_program::compile_shader(const shader_src &source) {
     const GLchar *src{source.src.c_str()};
     GLuint shader = glCreateShader(shader_gl_type.at(source.type));
     glShaderSource(shader, 1, &src, nullptr);
@@ -1351,7 +1700,7 @@ GLuint sdl_gl_shader::compile_shader(const shader_src &source) {
     }
     return shader;
 }
-GLuint sdl_gl_shader::create_program(const std::vector<shader_src> &sources) {
+GLuint sdl_gl_program::create_program(const std::vector<shader_src> &sources) {
     std::vector<GLuint> shaders;
     for (const auto &src : sources) {
         shaders.push_back(compile_shader(src));
@@ -1398,26 +1747,33 @@ GLuint sdl_gl_shader::create_program(const std::vector<shader_src> &sources) {
     shaders.clear();
     return new_program;
 }
+sdl_gl_shader::~sdl_gl_shader() {
+    // the program is deleted by sdl_gl_program once no shader references it
+}
+void sdl_gl_shader::activate() {
+    glUseProgram(program->get_id());
+    gl_frame_stats().program_binds++;
+}
 void sdl_gl_shader::upload_mat4(const std::string &name, const squint::fmat4 &value, bool suppress_warnings) {
-    if (!resource_location_cache.count(name)) {
-        // cache the location
-        resource_location_cache.insert_or_assign(name, glGetProgramResourceLocation(program, GL_UNIFORM, name.c_str()));
-    }
-    if (resource_location_cache[name] == -1 && suppress_warnings == false) {
-        std::cerr << "SHADER WARNING: No uniform '" << name << "' exists in the shader" << std::endl;
+    GLint location = program->uniform_location(name);
+    if (location == -1) {
+        if (suppress_warnings == false) {
+            std::cerr << "SHADER WARNING: No uniform '" << name << "' exists in the shader" << std::endl;
+        }
     } else {
-        glUniformMatrix4fv(resource_location_cache[name], 1, GL_FALSE, value.data());
+        glUniformMatrix4fv(location, 1, GL_FALSE, value.data());
+        gl_frame_stats().uniform_uploads++;
     }
 }
 void sdl_gl_shader::upload_vec4(const std::string &name, const squint::fvec4 &value, bool suppress_warnings) {
-    if (!resource_location_cache.count(name)) {
-        // cache the location
-        resource_location_cache.insert_or_assign(name, glGetProgramResourceLocation(program, GL_UNIFORM, name.c_str()));
-    }
-    if (resource_location_cache[name] == -1 && suppress_warnings == false) {
-        std::cerr << "SHADER WARNING: No uniform '" << name << "' exists in the shader" << std::endl;
+    GLint location = program->uniform_location(name);
+    if (location == -1) {
+        if (suppress_warnings == false) {
+            std::cerr << "SHADER WARNING: No uniform '" << name << "' exists in the shader" << std::endl;
+        }
     } else {
-        glUniform4f(resource_location_cache[name], value[0], value[1], value[2], value[3]);
+        glUniform4f(location, value[0], value[1], value[2], value[3]);
+        gl_frame_stats().uniform_uploads++;
     }
 }
 void sdl_gl_shader::upload_texture2D(const std::string &name, const texture2D *texture, bool suppress_warnings) {
@@ -1425,16 +1781,17 @@ void sdl_gl_shader::upload_texture2D(const std::string &name, const texture2D *t
         // no data to upload
         return;
     }
-    if (!resource_location_cache.count(name)) {
-        // cache the location
-        resource_location_cache.insert_or_assign(name, glGetProgramResourceLocation(program, GL_UNIFORM, name.c_str()));
-        texture_binding_cache.insert_or_assign(name, static_cast<GLuint>(texture_binding_cache.size()));
-        glUniform1i(resource_location_cache[name], texture_binding_cache[name]);
-    }
-    if (resource_location_cache[name] == -1 && suppress_warnings == false) {
-        std::cerr << "SHADER WARNING: No uniform sampler2D '" << name << "' exists in the shader" << std::endl;
+    GLint unit = program->texture_unit(name);
+    if (unit == -1) {
+        if (suppress_warnings == false) {
+            std::cerr << "SHADER WARNING: No uniform sampler2D '" << name << "' exists in the shader" << std::endl;
+        }
     } else {
-        glBindTextureUnit(texture_binding_cache[name], texture->get_id());
+        glBindTextureUnit(static_cast<GLuint>(unit), texture->get_id());
+        // shaders are only used with the renderer that generated them
+        auto gl_renderer = static_cast<sdl_gl_renderer *>(app::renderer());
+        glBindSampler(static_cast<GLuint>(unit), gl_renderer->get_sampler(texture->get_sampler()));
+        gl_renderer->get_frame_stats().texture_binds++;
     }
 }
 void sdl_gl_shader::upload_storage_buffer(const std::string &name, const buffer *ssbo, bool suppress_warnings) {
@@ -1442,49 +1799,458 @@ void sdl_gl_shader::upload_storage_buffer(const std::string &name, const buffer
         // no data to upload
         return;
     }
-    if (!resource_location_cache.count(name)) {
-        // cache the location
-        resource_location_cache.insert_or_assign(
-            name, glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, name.c_str()));
-        storage_binding_cache.insert_or_assign(name, static_cast<GLuint>(storage_binding_cache.size()));
-        glShaderStorageBlockBinding(program, resource_location_cache[name], storage_binding_cache[name]);
+    GLint binding = program->storage_binding(name);
+    if (binding == -1) {
+        if (suppress_warnings == false) {
+            std::cerr << "SHADER WARNING: No storage buffer block '" << name << "' exists in the shader" << std::endl;
+        }
+    } else {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(binding), ssbo->get_id());
+        gl_frame_stats().storage_buffer_binds++;
     }
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, storage_binding_cache[name], ssbo->get_id());
-    if (resource_location_cache[name] == GL_INVALID_INDEX && suppress_warnings == false) {
-        std::cerr << "SHADER WARNING: No storage buffer block '" << name << "' exists in the shader" << std::endl;
+}
+uint32_t sdl_gl_shader::get_id() { return program->get_id(); }
+GLint sdl_gl_shader::storage_binding(const std::string &name) { return program->storage_binding(name); }
+sdl_gl_image sdl_gl_image::decode(const std::filesystem::path &image_filepath) {
+    sdl_gl_image image = read_level(image_filepath);
+    for (int level = 1;; level++) {
+        auto mip_filename = image_filepath.stem().string() + ".mip" + std::to_string(level) +
+                            image_filepath.extension().string();
+        auto mip_filepath = image_filepath.parent_path() / mip_filename;
+        if (!std::filesystem::exists(mip_filepath)) {
+            break;
+        }
+        sdl_gl_image mip = read_level(mip_filepath);
+        if (mip.width != std::max(1, image.width >> level) || mip.height != std::max(1, image.height >> level) ||
+            mip.type != image.type) {
+            throw std::runtime_error("Mip level " + mip_filepath.string() + " does not match the size or format of " +
+                                     image_filepath.string());
+        }
+        image.mip_levels.push_back(std::move(mip.pixels));
     }
+    return image;
 }
-uint32_t sdl_gl_shader::get_id() { return program; }
-sdl_gl_texture2D::sdl_gl_texture2D(const std::filesystem::path &image_filepath) {
+sdl_gl_image sdl_gl_image::read_level(const std::filesystem::path &image_filepath) {
     SDL_Surface *surface = IMG_Load(image_filepath.string().c_str());
     if (surface == nullptr) {
         throw std::runtime_error("Could not read image " + image_filepath.string());
     }
-    width = surface->w;
-    height = surface->h;
-    uint8_t channels = surface->format->BytesPerPixel;
-    glCreateBuffers(1, &buffer_id);
-    glNamedBufferStorage(buffer_id, width * height * channels, surface->pixels, 0);
-    SDL_FreeSurface(surface);
-
-    glCreateTextures(GL_TEXTURE_2D, 1, &texture_id);
+    if (surface->format->palette) {
+        // expand palettized images to RGBA
+        SDL_Surface *converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+        SDL_FreeSurface(surface);
+        if (converted == nullptr) {
+            throw std::runtime_error("Could not convert image " + image_filepath.string());
+        }
+        surface = converted;
+    }
+    sdl_gl_image image{};
+    image.width = surface->w;
+    image.height = surface->h;
+    int channels = surface->format->BytesPerPixel;
     switch (channels) {
     case 1:
-        tex_type = texture_type::R8;
+        image.type = texture_type::R8;
         break;
     case 2:
-        tex_type = texture_type::RG8;
+        image.type = texture_type::RG8;
         break;
     case 3:
-        tex_type = texture_type::RGB8;
+        image.type = texture_type::RGB8;
         break;
-    case 4:
-        tex_type = texture_type::RGBA8;
+    default:
+        image.type = texture_type::RGBA8;
         break;
     }
-    glTextureStorage2D(texture_id, 1, gl_sized_tex_format(tex_type), width, height);
+    // surface rows may be padded, the image rows are tightly packed
+    size_t row_bytes = static_cast<size_t>(image.width) * channels;
+    image.pixels.resize(row_bytes * image.height);
+    for (int row = 0; row < image.height; row++) {
+        std::memcpy(image.pixels.data() + row * row_bytes,
+                    static_cast<const uint8_t *>(surface->pixels) + row * surface->pitch, row_bytes);
+    }
+    SDL_FreeSurface(surface);
+    return image;
+}
+void sdl_gl_texture2D::upload(const sdl_gl_image &image) {
+    if (ready) {
+        return;
+    }
+    width = image.width;
+    height = image.height;
+    tex_type = image.type;
+    // all levels are staged in one pixel unpack buffer
+    size_t staging_bytes = image.pixels.size();
+    for (const auto &mip : image.mip_levels) {
+        staging_bytes += mip.size();
+    }
+    GLuint buffer_id;
+    glCreateBuffers(1, &buffer_id);
+    glNamedBufferStorage(buffer_id, staging_bytes, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glNamedBufferSubData(buffer_id, 0, image.pixels.size(), image.pixels.data());
+    size_t offset = image.pixels.size();
+    for (const auto &mip : image.mip_levels) {
+        glNamedBufferSubData(buffer_id, offset, mip.size(), mip.data());
+        offset += mip.size();
+    }
+
+    // the full chain is allocated even if only some levels were supplied, the rest are generated
+    int levels = gl_mip_level_count(width, height);
+    int supplied_levels = std::min(levels, 1 + static_cast<int>(image.mip_levels.size()));
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture_id);
+    glTextureStorage2D(texture_id, levels, gl_sized_tex_format(tex_type), width, height);
+    allocated_bytes = gl_texture_storage_bytes(width, height, 1, levels, image.pixels.size() / (width * height));
+    gpu_memory.texture_bytes += allocated_bytes;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows are tightly packed
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_id);
     glTextureSubImage2D(texture_id, 0, 0, 0, width, height, gl_tex_format(tex_type), gl_tex_type(tex_type), nullptr);
+    offset = image.pixels.size();
+    for (int level = 1; level < supplied_levels; level++) {
+        glTextureSubImage2D(texture_id, level, 0, 0, std::max(1, width >> level), std::max(1, height >> level),
+                            gl_tex_format(tex_type), gl_tex_type(tex_type), reinterpret_cast<const void *>(offset));
+        offset += image.mip_levels[level - 1].size();
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (supplied_levels < levels) {
+        // generate the levels below the last supplied one from it
+        glTextureParameteri(texture_id, GL_TEXTURE_BASE_LEVEL, supplied_levels - 1);
+        glGenerateTextureMipmap(texture_id);
+        glTextureParameteri(texture_id, GL_TEXTURE_BASE_LEVEL, 0);
+    }
+    // the driver keeps the buffer alive until the copy into the texture has completed
+    glDeleteBuffers(1, &buffer_id);
+    gl_frame_stats().texture_bytes_uploaded += staging_bytes;
+    ready = true;
+}
+sdl_gl_texture2D_array::sdl_gl_texture2D_array(const std::vector<std::filesystem::path> &image_filepaths,
+                                               texture_packing packing, int atlas_size) {
+    if (image_filepaths.empty()) {
+        throw std::runtime_error("A texture array needs at least one image");
+    }
+    std::vector<sdl_gl_image> images{};
+    images.reserve(image_filepaths.size());
+    for (const auto &image_filepath : image_filepaths) {
+        images.push_back(sdl_gl_image::decode(image_filepath));
+        if (images.back().type != images.front().type) {
+            throw std::runtime_error("Image " + image_filepath.string() + " does not match the format of " +
+                                     image_filepaths.front().string());
+        }
+    }
+    const sdl_gl_image &first = images.front();
+    texture_type tex_type = first.type;
+    size_t texel_bytes = first.pixels.size() / (static_cast<size_t>(first.width) * first.height);
+    int width = 0;
+    int height = 0;
+    int levels = 1;
+    std::vector<std::vector<uint8_t>> pages{};
+    regions.resize(images.size());
+    if (packing == texture_packing::LAYERS) {
+        width = first.width;
+        height = first.height;
+        for (size_t i = 0; i < images.size(); i++) {
+            if (images[i].width != width || images[i].height != height) {
+                throw std::runtime_error("Image " + image_filepaths[i].string() + " does not match the size of " +
+                                         image_filepaths.front().string());
+            }
+            regions[i].uv_rect = squint::fvec4({0.f, 0.f, 1.f, 1.f});
+            regions[i].layer = static_cast<uint32_t>(i);
+            pages.push_back(std::move(images[i].pixels));
+        }
+        levels = gl_mip_level_count(width, height);
+    } else {
+        width = atlas_size;
+        height = atlas_size;
+        std::vector<size_t> order(images.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [&images](size_t a, size_t b) { return images[a].height > images[b].height; });
+        // One texel of gutter is averaged away per level. That only holds if the texels averaged into a texel of the
+        // last level never come from two images, so the images are placed on multiples of the size of those blocks.
+        levels = std::min(gl_mip_level_count(width, height), std::bit_width(static_cast<unsigned int>(atlas_padding)));
+        int alignment = 1 << (levels - 1);
+        auto align = [alignment](int size) { return (size + alignment - 1) / alignment * alignment; };
+        int x = 0;
+        int y = 0;
+        int shelf_height = 0;
+        for (size_t i : order) {
+            const auto &image = images[i];
+            int padded_width = align(image.width + 2 * atlas_padding);
+            int padded_height = align(image.height + 2 * atlas_padding);
+            if (padded_width > atlas_size || padded_height > atlas_size) {
+                throw std::runtime_error("Image " + image_filepaths[i].string() + " does not fit in a " +
+                                         std::to_string(atlas_size) + "x" + std::to_string(atlas_size) + " atlas");
+            }
+            if (x + padded_width > atlas_size) {
+                x = 0;
+                y += shelf_height;
+                shelf_height = 0;
+            }
+            if (pages.empty() || y + padded_height > atlas_size) {
+                pages.emplace_back(static_cast<size_t>(atlas_size) * atlas_size * texel_bytes, 0);
+                x = 0;
+                y = 0;
+                shelf_height = 0;
+            }
+            copy_padded(image, texel_bytes, pages.back(), atlas_size, x, y);
+            float size = static_cast<float>(atlas_size);
+            regions[i].uv_rect = squint::fvec4({(x + atlas_padding) / size, (y + atlas_padding) / size,
+                                                image.width / size, image.height / size});
+            regions[i].layer = static_cast<uint32_t>(pages.size() - 1);
+            x += padded_width;
+            shelf_height = std::max(shelf_height, padded_height);
+        }
+    }
+    layer_count = static_cast<uint32_t>(pages.size());
+
+    size_t page_bytes = pages.front().size();
+    GLuint buffer_id;
+    glCreateBuffers(1, &buffer_id);
+    glNamedBufferStorage(buffer_id, page_bytes * pages.size(), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    for (size_t layer = 0; layer < pages.size(); layer++) {
+        glNamedBufferSubData(buffer_id, layer * page_bytes, page_bytes, pages[layer].data());
+    }
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture_id);
+    glTextureStorage3D(texture_id, levels, gl_sized_tex_format(tex_type), width, height, layer_count);
+    allocated_bytes = gl_texture_storage_bytes(width, height, layer_count, levels, texel_bytes);
+    gpu_memory.texture_bytes += allocated_bytes;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows are tightly packed
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_id);
+    glTextureSubImage3D(texture_id, 0, 0, 0, 0, width, height, layer_count, gl_tex_format(tex_type),
+                        gl_tex_type(tex_type), nullptr);
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (levels > 1) {
+        glGenerateTextureMipmap(texture_id);
+    }
+    glDeleteBuffers(1, &buffer_id);
+    gl_frame_stats().texture_bytes_uploaded += page_bytes * pages.size();
+}
+void sdl_gl_texture2D_array::copy_padded(const sdl_gl_image &image, size_t texel_bytes, std::vector<uint8_t> &page,
+                                         int page_size, int x, int y) {
+    size_t row_bytes = static_cast<size_t>(image.width) * texel_bytes;
+    for (int row = -atlas_padding; row < image.height + atlas_padding; row++) {
+        // rows of the gutter repeat the first and last image rows
+        const uint8_t *src = image.pixels.data() + std::clamp(row, 0, image.height - 1) * row_bytes;
+        uint8_t *dst = page.data() + (static_cast<size_t>(y + atlas_padding + row) * page_size + x) * texel_bytes;
+        for (int col = 0; col < atlas_padding; col++) {
+            std::memcpy(dst + col * texel_bytes, src, texel_bytes);
+            std::memcpy(dst + (atlas_padding + image.width + col) * texel_bytes, src + row_bytes - texel_bytes,
+                        texel_bytes);
+        }
+        std::memcpy(dst + atlas_padding * texel_bytes, src, row_bytes);
+    }
+}
+sdl_gl_gpu_timer::~sdl_gl_gpu_timer() {
+    for (const auto &zone : pending) {
+        glDeleteQueries(1, &zone.query);
+    }
+    glDeleteQueries(static_cast<GLsizei>(free_queries.size()), free_queries.data());
+}
+void sdl_gl_gpu_timer::begin(const char *name) {
+    if (depth++ > 0) {
+        return;
+    }
+    GLuint query;
+    if (free_queries.empty()) {
+        glCreateQueries(GL_TIME_ELAPSED, 1, &query);
+    } else {
+        query = free_queries.back();
+        free_queries.pop_back();
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    pending.push_back({query, name, profiler::instance().now_ns()});
+}
+void sdl_gl_gpu_timer::end() {
+    if (depth == 0 || --depth > 0) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+}
+void sdl_gl_gpu_timer::collect() {
+    // queries complete in the order they were issued so stop at the first one that isn't available yet
+    while (!pending.empty()) {
+        const pending_zone &zone = pending.front();
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(zone.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available == GL_FALSE) {
+            break;
+        }
+        GLuint64 elapsed_ns = 0;
+        glGetQueryObjectui64v(zone.query, GL_QUERY_RESULT, &elapsed_ns);
+        profiler::instance().record_gpu(zone.name, zone.start_ns, static_cast<int64_t>(elapsed_ns));
+        free_queries.push_back(zone.query);
+        pending.pop_front();
+    }
+}
+sdl_gl_render_target::sdl_gl_render_target(uint32_t width, uint32_t height, int samples, bool depth)
+    : render_target(width, height, std::max(samples, 1), depth) {
+    auto w = static_cast<GLsizei>(width);
+    auto h = static_cast<GLsizei>(height);
+    int64_t texels = static_cast<int64_t>(width) * height;
+    glCreateTextures(GL_TEXTURE_2D, 1, &color_texture_id);
+    glTextureStorage2D(color_texture_id, 1, GL_RGBA8, w, h);
+    color_texture = std::make_unique<sdl_gl_attachment_texture>(color_texture_id);
+    allocated_bytes += texels * 4;
+    glCreateFramebuffers(1, &framebuffer);
+    if (this->samples > 1) {
+        glCreateRenderbuffers(1, &color_renderbuffer);
+        glNamedRenderbufferStorageMultisample(color_renderbuffer, this->samples, GL_RGBA8, w, h);
+        glNamedFramebufferRenderbuffer(framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_renderbuffer);
+        allocated_bytes += texels * 4 * this->samples;
+        if (depth) {
+            glCreateRenderbuffers(1, &depth_renderbuffer);
+            glNamedRenderbufferStorageMultisample(depth_renderbuffer, this->samples, GL_DEPTH_COMPONENT32F, w, h);
+            glNamedFramebufferRenderbuffer(framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_renderbuffer);
+            allocated_bytes += texels * 4 * this->samples;
+        }
+        glCreateFramebuffers(1, &resolve_framebuffer);
+        glNamedFramebufferTexture(resolve_framebuffer, GL_COLOR_ATTACHMENT0, color_texture_id, 0);
+    } else {
+        glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0, color_texture_id, 0);
+        if (depth) {
+            glCreateTextures(GL_TEXTURE_2D, 1, &depth_texture_id);
+            glTextureStorage2D(depth_texture_id, 1, GL_DEPTH_COMPONENT32F, w, h);
+            glNamedFramebufferTexture(framebuffer, GL_DEPTH_ATTACHMENT, depth_texture_id, 0);
+            depth_texture = std::make_unique<sdl_gl_attachment_texture>(depth_texture_id);
+            allocated_bytes += texels * 4;
+        }
+    }
+    gpu_memory.texture_bytes += allocated_bytes;
+    if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE ||
+        (resolve_framebuffer &&
+         glCheckNamedFramebufferStatus(resolve_framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)) {
+        throw std::runtime_error("Error render target framebuffer is incomplete\n");
+    }
+}
+sdl_gl_render_target::~sdl_gl_render_target() {
+    // deleting 0 is silently ignored
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteFramebuffers(1, &resolve_framebuffer);
+    glDeleteRenderbuffers(1, &color_renderbuffer);
+    glDeleteRenderbuffers(1, &depth_renderbuffer);
+    glDeleteTextures(1, &color_texture_id);
+    glDeleteTextures(1, &depth_texture_id);
+    gpu_memory.texture_bytes -= allocated_bytes;
+}
+void sdl_gl_render_target::resolve(uint32_t width, uint32_t height) {
+    if (resolve_framebuffer) {
+        auto w = static_cast<GLint>(width);
+        auto h = static_cast<GLint>(height);
+        glBlitNamedFramebuffer(framebuffer, resolve_framebuffer, 0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT,
+                               GL_NEAREST);
+    }
+}
+sdl_gl_frame_timer::sdl_gl_frame_timer() {
+    glCreateQueries(GL_TIMESTAMP, static_cast<GLsizei>(queries.size()), queries.data());
+    for (size_t i = 0; i < frame_count; i++) {
+        free_frames.push_back(i);
+    }
+}
+void sdl_gl_frame_timer::begin() {
+    if (free_frames.empty()) {
+        return;
+    }
+    current = static_cast<int>(free_frames.back());
+    free_frames.pop_back();
+    glQueryCounter(queries[2 * current], GL_TIMESTAMP);
+}
+void sdl_gl_frame_timer::end() {
+    if (current < 0) {
+        return;
+    }
+    glQueryCounter(queries[2 * current + 1], GL_TIMESTAMP);
+    pending.push_back(static_cast<size_t>(current));
+    current = -1;
+}
+bool sdl_gl_frame_timer::next_result(int64_t &duration_ns) {
+    if (pending.empty()) {
+        return false;
+    }
+    size_t frame = pending.front();
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(queries[2 * frame + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available == GL_FALSE) {
+        return false;
+    }
+    GLuint64 start_ns = 0;
+    GLuint64 end_ns = 0;
+    glGetQueryObjectui64v(queries[2 * frame], GL_QUERY_RESULT, &start_ns);
+    glGetQueryObjectui64v(queries[2 * frame + 1], GL_QUERY_RESULT, &end_ns);
+    duration_ns = static_cast<int64_t>(end_ns - start_ns);
+    free_frames.push_back(frame);
+    pending.pop_front();
+    return true;
+}
+sdl_gl_texture_loader::sdl_gl_texture_loader() {
+    // a single grey texel is shown while images are loading
+    const uint8_t grey[4] = {128, 128, 128, 255};
+    glCreateTextures(GL_TEXTURE_2D, 1, &placeholder_id);
+    glTextureStorage2D(placeholder_id, 1, GL_RGBA8, 1, 1);
+    glTextureSubImage2D(placeholder_id, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+}
+std::shared_ptr<texture2D> sdl_gl_texture_loader::load(const std::filesystem::path &image_filepath) {
+    std::string key = std::filesystem::absolute(image_filepath).lexically_normal().string();
+    if (auto it = textures.find(key); it != textures.end()) {
+        if (auto texture = it->second.lock()) {
+            return texture;
+        }
+    }
+    std::erase_if(textures, [](const auto &entry) { return entry.second.expired(); });
+    auto texture = std::make_shared<sdl_gl_texture2D>(placeholder_id);
+    textures[key] = texture;
+    app::jobs().submit([queue = decoded, key, image_filepath]() {
+        decoded_image result{key};
+        try {
+            result.image = sdl_gl_image::decode(image_filepath);
+        } catch (const std::exception &e) {
+            result.error = e.what();
+        }
+        {
+            std::lock_guard lock(queue->mutex);
+            queue->images.push_back(std::move(result));
+        }
+        // the image is uploaded at the start of the next frame, which idle renderers are waiting for
+        sdl_gl_renderer::wake();
+    });
+    return texture;
+}
+size_t sdl_gl_texture_loader::process_uploads(size_t byte_budget) {
+    std::vector<decoded_image> uploads{};
+    size_t uploaded = 0;
+    {
+        std::lock_guard lock(decoded->mutex);
+        size_t count = 0;
+        size_t bytes = 0;
+        while (count < decoded->images.size() && (count == 0 || bytes < byte_budget)) {
+            bytes += decoded->images[count].image.pixels.size();
+            count++;
+        }
+        std::move(decoded->images.begin(), decoded->images.begin() + count, std::back_inserter(uploads));
+        decoded->images.erase(decoded->images.begin(), decoded->images.begin() + count);
+    }
+    for (const auto &upload : uploads) {
+        // the texture may have been released while the image was decoding
+        auto it = textures.find(upload.key);
+        if (!upload.error.empty()) {
+            std::cerr << "TEXTURE WARNING: " << upload.error << std::endl;
+            // the next load() of the path tries again instead of returning the failed texture
+            if (it != textures.end()) {
+                if (auto texture = it->second.lock()) {
+                    texture->fail();
+                }
+                textures.erase(it);
+            }
+            continue;
+        }
+        if (it != textures.end()) {
+            if (auto texture = it->second.lock()) {
+                texture->upload(upload.image);
+                mark_scene_changed();
+                uploaded++;
+            }
+        }
+    }
+    return uploaded;
 }
 } // namespace square
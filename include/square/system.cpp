@@ -1,5 +1,13 @@
 module;
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cassert>
+#include <cmath>
 #include <cstdint>
+#include <typeindex>
+#include <typeinfo>
+#include <vector>
 export module square:system;
 import squint;
 export namespace square {
@@ -237,6 +245,51 @@ enum class key_event {
     MENU_DOWN,
     MENU_UP,
 };
+// Every key has a _DOWN event followed by an _UP event, keys are numbered in that order
+inline constexpr size_t key_count = static_cast<size_t>(key_event::MENU_UP) / 2 + 1;
+constexpr size_t key_index(key_event event) { return static_cast<size_t>(event) / 2; }
+constexpr bool is_key_down_event(key_event event) { return static_cast<size_t>(event) % 2 == 0; }
+constexpr key_event key_up_event(key_event down_event) {
+    return static_cast<key_event>(static_cast<size_t>(down_event) | 1);
+}
+// The input of a renderer, updated as events are handled and read with renderer::get_input(). Systems can poll it
+// instead of tracking the state of keys and buttons in their event callbacks.
+struct input_state {
+    std::bitset<key_count> keys{};  // keys held down by key_index()
+    std::bitset<3> mouse_buttons{}; // left, middle and right mouse buttons held down
+    int mouse_x = 0;                // last reported window coordinates of the mouse
+    int mouse_y = 0;
+    int mouse_dx = 0; // relative motion of the mouse since the start of the frame
+    int mouse_dy = 0;
+    float wheel_x = 0.f; // scrolled since the start of the frame
+    float wheel_y = 0.f;
+    // either event of the key can be given, e.g. key_event::W_DOWN
+    inline bool is_key_down(key_event key) const { return keys[key_index(key)]; }
+    // either event of the button can be given, e.g. mouse_button_event::LEFT_MOUSE_DOWN
+    inline bool is_mouse_button_down(mouse_button_event button) const {
+        return mouse_buttons[static_cast<size_t>(button) % 3];
+    }
+    void record(const key_event &event) { keys[key_index(event)] = is_key_down_event(event); }
+    void record(const mouse_button_event &event) {
+        size_t value = static_cast<size_t>(event);
+        mouse_buttons[value % 3] = value < 3;
+    }
+    void record(const mouse_move_event &event) {
+        mouse_x = event.x;
+        mouse_y = event.y;
+        mouse_dx += event.xrel;
+        mouse_dy += event.yrel;
+    }
+    void record(const mouse_scroll_event &event) {
+        wheel_x += event.x;
+        wheel_y += event.y;
+    }
+    // reset the motion accumulated over a frame
+    void begin_frame() {
+        mouse_dx = mouse_dy = 0;
+        wheel_x = wheel_y = 0.f;
+    }
+};
 
 // System that provides render() callback for entities
 // render() called once per frame with dt equal to the wall-clock time between frames
@@ -245,13 +298,124 @@ template <typename T> class render_system {
     virtual void render(squint::quantities::time_f dt, T &entity) const {}
     virtual ~render_system() {}
 };
+// The components a system reads and writes, so systems that don't touch the same data can run at the same time.
+//
+// Components are identified by a type, e.g. transform, or a tag struct standing for a concept like a velocity member.
+// Components of the entity a system runs on are separate for each entity. Shared components, e.g. a physics world or
+// a global counter, are the same for every entity, so systems accessing them conflict across entities.
+class system_access {
+  public:
+    template <typename... C> system_access &reads() {
+        (add(typeid(C), false, false), ...);
+        return *this;
+    }
+    template <typename... C> system_access &writes() {
+        (add(typeid(C), true, false), ...);
+        return *this;
+    }
+    template <typename... C> system_access &reads_shared() {
+        (add(typeid(C), false, true), ...);
+        return *this;
+    }
+    template <typename... C> system_access &writes_shared() {
+        (add(typeid(C), true, true), ...);
+        return *this;
+    }
+    struct component {
+        std::type_index type;
+        bool write;
+        bool shared;
+    };
+    inline const std::vector<component> &get_components() const { return components; }
+    // true if the component type may be accessed, writes must be declared with writes() or writes_shared()
+    bool allows(std::type_index type, bool write) const {
+        return std::any_of(components.begin(), components.end(),
+                           [&](const component &c) { return c.type == type && (c.write || !write); });
+    }
+
+  private:
+    void add(std::type_index type, bool write, bool shared) {
+        auto it = std::find_if(components.begin(), components.end(),
+                               [&](const component &c) { return c.type == type && c.shared == shared; });
+        if (it == components.end()) {
+            components.push_back({type, write, shared});
+        } else {
+            it->write = it->write || write;
+        }
+    }
+    std::vector<component> components{};
+};
+// The access of the system running on this thread, set by the system scheduler in debug builds
+inline thread_local const system_access *running_system_access = nullptr;
+// Check in debug builds that the running system declared access to a component type, e.g. called by transforms when
+// they change. Systems that didn't declare their access aren't checked.
+//
+// Only the type is checked, components don't know which entity owns them. Components the entity owns, including
+// members it holds on the heap like the meshes in its unique_ptrs, count as the entity's and are declared with reads()
+// or writes(). The components of other entities must be declared with reads_shared() or writes_shared(), which this
+// check can't tell apart from the entity's own. A system changing a local transform also declares writes<transform>().
+template <typename C> void check_access([[maybe_unused]] bool write) {
+#ifndef NDEBUG
+    assert((!running_system_access || running_system_access->allows(typeid(C), write)) &&
+           "A system accessed a component it did not declare in its system_access");
+#endif
+}
 // System that provides update() callback for entities
-// update() called once per frame with dt equal to a small fixed amount set in the renderer settings
+// update() called once per frame with dt equal to a small fixed amount set in the renderer settings, or at the rate the
+// system was attached with, see physics_schedule
 template <typename T> class physics_system {
   public:
     virtual void update(squint::quantities::time_f dt, T &entity) const {}
+    // The components update() reads and writes, nullptr if they aren't declared. Renderers with
+    // properties.parallel_systems run systems with declared access in parallel with the systems they don't conflict
+    // with. Systems that don't declare their access run alone.
+    virtual const system_access *get_access() const { return nullptr; }
     virtual ~physics_system() {}
 };
+// How often a physics system attached to an entity runs.
+//
+// By default a system runs once per update with the update's dt. A system with a rate runs rate times per second of
+// simulated time with a dt of 1 / rate, as many times per update as the update's dt covers, e.g. about 17 times per
+// update at 1 kHz with the default fixed_dt, or every 6th update at 10 Hz. Systems with a rate start at a different
+// phase of their period each, so low rate systems attached at the same time spread across updates instead of all
+// running in the same one.
+class physics_schedule {
+  public:
+    physics_schedule() {}
+    physics_schedule(float rate) : period(rate > 0.f ? 1.0 / rate : 0.0) {
+        // the golden ratio spreads consecutive phases evenly over the period
+        static std::atomic<uint32_t> attached = 0;
+        double phase = std::fmod(attached++ * 0.6180339887498949, 1.0);
+        elapsed = phase * period;
+    }
+    // advance by the dt of an update, returns the number of times the system runs in it
+    size_t advance(squint::quantities::time_f dt) {
+        if (period == 0.0) {
+            return 1;
+        }
+        elapsed += dt.as_seconds();
+        double runs = std::floor(elapsed / period);
+        elapsed -= runs * period;
+        return static_cast<size_t>(runs);
+    }
+    // the dt of each run of the system in an update of dt
+    inline squint::quantities::time_f step(squint::quantities::time_f dt) const {
+        return period == 0.0 ? dt : squint::quantities::time_f{static_cast<float>(period)};
+    }
+
+  private:
+    double period = 0.0;  // seconds between runs, 0 to run once per update
+    double elapsed = 0.0; // seconds since the last run
+};
+// The runs of a physics system on an entity in an update, collected for the system scheduler
+struct physics_run {
+    const system_access *access; // nullptr if the system doesn't declare its access
+    const void *system;
+    void *entity;
+    size_t runs;
+    squint::quantities::time_f step;
+    void (*run)(const physics_run &); // calls the system's update() runs times with step
+};
 // System that provides event callbacks for entities
 // callbacks are called once for each relevant event that occured between frames
 template <typename T> class controls_system {
@@ -0,0 +1,147 @@
+module;
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+export module square:system_scheduler;
+import :system;
+import :thread_pool;
+import :profiler;
+
+export namespace square {
+// Runs the physics systems of an update in parallel where their declared access allows it.
+//
+// The runs are ordered into levels. A run comes after every earlier run it conflicts with: a run writing a component
+// comes after the earlier runs reading or writing it, and a run reading a component comes after the earlier runs
+// writing it. Components of an entity only conflict between runs on that entity, shared components conflict between
+// all runs. A shared access of a component type also conflicts with the accesses of that type on every entity, e.g.
+// a system reading the transforms of other entities comes after the earlier systems writing their own transform.
+// Runs of systems that don't declare their access get a level of their own after every earlier run. The runs of a
+// level don't conflict, so they are split between the jobs of a thread pool and the calling thread. The levels run
+// one after another, so the result is the same as running the systems in order.
+//
+// In debug builds, the access of the running system is checked by check_access(), e.g. when a transform changes.
+class system_scheduler {
+  public:
+    // Run the runs in order of their levels. in_job(job) calls job() on a worker thread with the state of the calling
+    // thread that the systems depend on, e.g. its active renderer.
+    template <typename J> void run(const std::vector<physics_run> &runs, thread_pool &jobs, J &&in_job) {
+        build_levels(runs);
+        for (size_t level = 0; level + 1 < level_starts.size(); level++) {
+            size_t begin = level_starts[level];
+            size_t end = level_starts[level + 1];
+            if (!ordered[begin]->access) {
+                run_range(ordered.data() + begin, ordered.data() + end);
+            } else {
+                // ranges of at least min_range runs, so a job is worth starting
+                constexpr size_t min_range = 64;
+                size_t count = end - begin;
+                size_t ranges = std::clamp<size_t>(count / min_range, 1, jobs.size() + 1);
+                parallel_for(jobs, ranges, in_job, [this, begin, count, ranges](size_t i) {
+                    run_range(ordered.data() + begin + count * i / ranges,
+                              ordered.data() + begin + count * (i + 1) / ranges);
+                });
+            }
+        }
+    }
+    // number of levels the last update was split into
+    inline size_t get_level_count() const { return level_starts.empty() ? 0 : level_starts.size() - 1; }
+
+  private:
+    static void run_range(const physics_run *const *begin, const physics_run *const *end) {
+        for (auto it = begin; it != end; it++) {
+            const physics_run &r = **it;
+#ifndef NDEBUG
+            running_system_access = r.access;
+            // also cleared when the system throws, so later code on the thread isn't checked against it
+            struct clear_running_system {
+                ~clear_running_system() { running_system_access = nullptr; }
+            } clear;
+#endif
+            r.run(r);
+        }
+    }
+    void build_levels(const std::vector<physics_run> &runs) {
+        profile_zone zone("build_system_levels");
+        components.clear();
+        levels.resize(runs.size());
+        size_t level_count = 0;
+        size_t first_free = 0; // the first level after the last run that doesn't declare its access
+        for (size_t i = 0; i < runs.size(); i++) {
+            const physics_run &r = runs[i];
+            if (!r.access) {
+                levels[i] = level_count;
+                first_free = ++level_count;
+                continue;
+            }
+            size_t level = first_free;
+            for (const auto &c : r.access->get_components()) {
+                auto wait_for = [&](const void *entity) {
+                    auto it = components.find({entity, c.type});
+                    if (it != components.end()) {
+                        level = std::max(level, c.write ? std::max(it->second.after_write, it->second.after_read)
+                                                        : it->second.after_write);
+                    }
+                };
+                // shared accesses conflict with the accesses on every entity and the other way around
+                wait_for(nullptr);
+                wait_for(c.shared ? &any_entity : r.entity);
+            }
+            for (const auto &c : r.access->get_components()) {
+                auto record = [&](const void *entity) {
+                    component_levels &cl = components[{entity, c.type}];
+                    cl.after_read = std::max(cl.after_read, level + 1);
+                    if (c.write) {
+                        cl.after_write = level + 1;
+                    }
+                };
+                if (c.shared) {
+                    record(nullptr);
+                } else {
+                    record(r.entity);
+                    record(&any_entity);
+                }
+            }
+            levels[i] = level;
+            level_count = std::max(level_count, level + 1);
+        }
+        // sort the runs by level, keeping their order within a level
+        level_starts.assign(level_count + 1, 0);
+        for (size_t level : levels) {
+            level_starts[level + 1]++;
+        }
+        for (size_t level = 0; level < level_count; level++) {
+            level_starts[level + 1] += level_starts[level];
+        }
+        ordered.resize(runs.size());
+        positions.assign(level_starts.begin(), level_starts.end() - 1);
+        for (size_t i = 0; i < runs.size(); i++) {
+            ordered[positions[levels[i]]++] = &runs[i];
+        }
+    }
+    // the key of the accesses of a component type on any entity
+    inline static const char any_entity = 0;
+    struct component_key {
+        const void *entity; // nullptr for shared components, &any_entity for the accesses on every entity
+        std::type_index type;
+        bool operator==(const component_key &other) const = default;
+    };
+    struct component_key_hash {
+        size_t operator()(const component_key &key) const {
+            return std::hash<const void *>()(key.entity) * 31 + key.type.hash_code();
+        }
+    };
+    // the first level a run reading or writing the component may have
+    struct component_levels {
+        size_t after_write = 0;
+        size_t after_read = 0;
+    };
+    std::unordered_map<component_key, component_levels, component_key_hash> components{};
+    std::vector<size_t> levels{};
+    std::vector<size_t> level_starts{};
+    std::vector<size_t> positions{};
+    std::vector<const physics_run *> ordered{};
+};
+} // namespace square
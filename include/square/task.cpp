@@ -0,0 +1,366 @@
+module;
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+export module square:task;
+import squint;
+
+export namespace square {
+// Pools the frames of tasks.
+//
+// Frames are kept in free lists of the calling thread, one per size class, and are not returned to the system until
+// the thread exits. Once a thread has run as many tasks of a size at once as it will, starting a task doesn't allocate.
+// Frames larger than the largest size class are allocated from the system.
+class task_frame_pool {
+  public:
+    static void *allocate(size_t size) {
+        size_t size_class = class_of(size);
+        if (size_class >= class_count) {
+            return ::operator new(size);
+        }
+        block *&head = lists().heads[size_class];
+        if (head) {
+            return std::exchange(head, head->next);
+        }
+        return ::operator new((size_class + 1) * granularity);
+    }
+    static void deallocate(void *frame, size_t size) {
+        size_t size_class = class_of(size);
+        if (size_class >= class_count) {
+            ::operator delete(frame);
+            return;
+        }
+        // frames freed on another thread than they were allocated on join that thread's list
+        block *&head = lists().heads[size_class];
+        head = ::new (frame) block{head};
+    }
+
+  private:
+    static constexpr size_t granularity = 64;
+    static constexpr size_t class_count = 16;
+    static size_t class_of(size_t size) { return (size + granularity - 1) / granularity - 1; }
+    struct block {
+        block *next;
+    };
+    struct free_lists {
+        block *heads[class_count]{};
+        ~free_lists() {
+            for (block *head : heads) {
+                while (head) {
+                    ::operator delete(std::exchange(head, head->next));
+                }
+            }
+        }
+    };
+    static free_lists &lists() {
+        thread_local free_lists thread_lists;
+        return thread_lists;
+    }
+};
+class task_scheduler;
+// A coroutine run by a task_scheduler, e.g. a scripted behavior or a loading sequence of an object.
+//
+// A task doesn't run when it is called. It runs once it is started with object::start_task() or
+// task_scheduler::start(), from the next time the scheduler runs until its first co_await, and continues from there
+// each time what it awaits is ready. See next_frame, seconds, asset_ready and job_done for what tasks can await.
+// Destroying a task destroys its coroutine frame, stopping it where it last suspended.
+class task {
+  public:
+    struct promise_type {
+        task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+        static void *operator new(size_t size) { return task_frame_pool::allocate(size); }
+        static void operator delete(void *frame, size_t size) { task_frame_pool::deallocate(frame, size); }
+        task_scheduler *scheduler = nullptr; // the scheduler running the task, nullptr if it isn't scheduled
+        size_t slot = 0;                     // the task's slot in its scheduler
+        std::exception_ptr exception = nullptr;
+    };
+    task(task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    task &operator=(task &&other) noexcept {
+        if (this != &other) {
+            reset();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    ~task() { reset(); }
+    // true once the task has returned or thrown
+    inline bool done() const { return !handle || handle.done(); }
+
+  private:
+    friend class task_scheduler;
+    explicit task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    void reset();
+    std::coroutine_handle<promise_type> handle;
+};
+// Resumes tasks when what they await is ready, once per frame.
+//
+// Renderers run their scheduler on the thread they render on, after the events of a frame are handled and before the
+// frame is updated, so tasks can change the object tree and call the rendering API. Tasks waiting for the next frame or
+// a time cost nothing until they are resumed. Tasks waiting for assets or jobs are checked each time the scheduler
+// runs.
+class task_scheduler {
+  public:
+    using clock = std::chrono::steady_clock;
+    task_scheduler() {}
+    task_scheduler(const task_scheduler &) = delete;
+    task_scheduler &operator=(const task_scheduler &) = delete;
+    ~task_scheduler() {
+        // the tasks may outlive the scheduler, e.g. in the objects of the renderer owning it
+        for (const auto &s : slots) {
+            if (s.handle) {
+                s.handle.promise().scheduler = nullptr;
+            }
+        }
+        for (const auto &s : started) {
+            s.handle.promise().scheduler = nullptr;
+        }
+    }
+    // the scheduler of the active renderer of this thread, which object::start_task() starts tasks with. Jobs running
+    // code of a renderer have the renderer's scheduler active, see app::scoped_active_renderer.
+    static task_scheduler *active() { return active_scheduler; }
+    static void set_active(task_scheduler *scheduler) { active_scheduler = scheduler; }
+    // Run the task from the next call to run(). The task isn't resumed while *paused is true, e.g. while the object it
+    // belongs to is disabled. Tasks that are done or already started are ignored. The task must stay alive while it
+    // runs, destroying it stops it. Safe to call while run() runs on another thread, e.g. from the jobs of pipelined
+    // updates.
+    void start(task &t, const bool *paused = nullptr) {
+        if (t.done() || t.handle.promise().scheduler) {
+            return;
+        }
+        t.handle.promise().scheduler = this;
+        t.handle.promise().slot = not_running;
+        std::lock_guard lock(started_mutex);
+        started.push_back({t.handle, paused});
+    }
+    // Resume the tasks that are ready at the time now. Rethrows the first exception thrown by a task, after the other
+    // tasks have been resumed.
+    void run(clock::time_point now) {
+        frame_time = now;
+        {
+            std::lock_guard lock(started_mutex);
+            for (const auto &s : started) {
+                size_t i = slots.size();
+                if (free_slots.empty()) {
+                    slots.push_back({});
+                } else {
+                    i = free_slots.back();
+                    free_slots.pop_back();
+                }
+                slots[i].handle = s.handle;
+                slots[i].paused = s.paused;
+                s.handle.promise().slot = i;
+                ready.push_back({i, slots[i].generation});
+            }
+            started.clear();
+        }
+        while (!timers.empty() && timers.top().deadline <= now) {
+            ready.push_back(timers.top().waiting);
+            timers.pop();
+        }
+        for (size_t i = 0; i < polls.size();) {
+            // the subject of a stopped task's poll may have been destroyed with its frame
+            if (!is_running(polls[i].waiting)) {
+                polls[i] = polls.back();
+                polls.pop_back();
+            } else if (polls[i].is_ready(polls[i].subject)) {
+                ready.push_back(polls[i].waiting);
+                polls[i] = polls.back();
+                polls.pop_back();
+            } else {
+                i++;
+            }
+        }
+        // tasks waiting for the next frame while they are resumed are added to ready for the next run
+        resuming.swap(ready);
+        std::exception_ptr error = nullptr;
+        for (const auto &waiting : resuming) {
+            if (!is_running(waiting)) {
+                continue;
+            }
+            slot &s = slots[waiting.slot];
+            if (s.paused && *s.paused) {
+                ready.push_back(waiting);
+                continue;
+            }
+            auto handle = s.handle;
+            handle.resume();
+            if (handle.done()) {
+                if (handle.promise().exception && !error) {
+                    error = handle.promise().exception;
+                }
+                release(waiting.slot);
+            }
+        }
+        resuming.clear();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    // the time of the frame being run, which tasks waiting for a time are resumed from
+    inline clock::time_point now() const { return frame_time; }
+    // number of tasks started before the last run() and not yet done or destroyed
+    inline size_t size() const { return slots.size() - free_slots.size(); }
+
+    // called by awaitables when the task suspends
+    void wait_frame(const task::promise_type &promise) { ready.push_back(waiting_of(promise)); }
+    void wait_until(const task::promise_type &promise, clock::time_point deadline) {
+        timers.push({deadline, waiting_of(promise)});
+    }
+    void wait_for(const task::promise_type &promise, const void *subject, bool (*is_ready)(const void *)) {
+        polls.push_back({waiting_of(promise), subject, is_ready});
+    }
+
+  private:
+    friend class task;
+    // Queues refer to tasks by slot and generation. A slot's generation changes when its task is done or destroyed,
+    // so entries left in the queues by stopped tasks are skipped.
+    struct slot {
+        std::coroutine_handle<task::promise_type> handle{};
+        const bool *paused = nullptr;
+        uint64_t generation = 0;
+    };
+    struct waiting_task {
+        size_t slot;
+        uint64_t generation;
+    };
+    struct timer {
+        clock::time_point deadline;
+        waiting_task waiting;
+        bool operator>(const timer &other) const { return deadline > other.deadline; }
+    };
+    struct poll {
+        waiting_task waiting;
+        const void *subject;
+        bool (*is_ready)(const void *);
+    };
+    inline bool is_running(const waiting_task &waiting) const {
+        return slots[waiting.slot].generation == waiting.generation && slots[waiting.slot].handle;
+    }
+    // the slot of tasks started since the last run()
+    static constexpr size_t not_running = static_cast<size_t>(-1);
+    struct started_task {
+        std::coroutine_handle<task::promise_type> handle;
+        const bool *paused;
+    };
+    // forget a task destroyed before it first ran
+    void cancel_start(std::coroutine_handle<task::promise_type> handle) {
+        std::lock_guard lock(started_mutex);
+        std::erase_if(started, [handle](const started_task &s) { return s.handle == handle; });
+    }
+    inline waiting_task waiting_of(const task::promise_type &promise) const {
+        return {promise.slot, slots[promise.slot].generation};
+    }
+    void release(size_t i) {
+        slots[i].handle.promise().scheduler = nullptr;
+        slots[i].handle = nullptr;
+        slots[i].paused = nullptr;
+        slots[i].generation++;
+        free_slots.push_back(i);
+    }
+    inline static thread_local task_scheduler *active_scheduler = nullptr;
+    std::vector<slot> slots{};
+    std::vector<size_t> free_slots{};
+    std::vector<waiting_task> ready{};
+    std::vector<waiting_task> resuming{};
+    std::priority_queue<timer, std::vector<timer>, std::greater<timer>> timers{};
+    std::vector<poll> polls{};
+    std::mutex started_mutex;
+    std::vector<started_task> started{}; // started since the last run(), possibly from other threads
+    clock::time_point frame_time{};
+};
+void task::reset() {
+    if (handle) {
+        if (task_scheduler *scheduler = handle.promise().scheduler) {
+            if (handle.promise().slot == task_scheduler::not_running) {
+                scheduler->cancel_start(handle);
+            } else {
+                scheduler->release(handle.promise().slot);
+            }
+        }
+        handle.destroy();
+        handle = nullptr;
+    }
+}
+
+// AWAITABLES ----------------------------------------------------------------------------------------------------------
+// co_await next_frame() resumes the task the next time its scheduler runs
+struct next_frame {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<task::promise_type> h) const {
+        h.promise().scheduler->wait_frame(h.promise());
+    }
+    void await_resume() const noexcept {}
+};
+// co_await seconds(t) resumes the task in the first frame at least t after the frame it was awaited in
+struct seconds {
+    seconds(squint::quantities::time_f duration) : duration(duration) {}
+    bool await_ready() const noexcept { return duration.as_seconds() <= 0.f; }
+    void await_suspend(std::coroutine_handle<task::promise_type> h) const {
+        task_scheduler *scheduler = h.promise().scheduler;
+        auto delay = std::chrono::duration_cast<task_scheduler::clock::duration>(
+            std::chrono::duration<float>(duration.as_seconds()));
+        scheduler->wait_until(h.promise(), scheduler->now() + delay);
+    }
+    void await_resume() const noexcept {}
+    squint::quantities::time_f duration;
+};
+// co_await asset_ready(asset) resumes the task once asset->is_ready() is true, e.g. for a texture returned by
+// renderer::load_texture(). If the asset has a has_failed() that becomes true instead, e.g. because the texture's
+// image could not be decoded, the task resumes and co_await throws std::runtime_error.
+template <typename T>
+    requires requires(const T &t) {
+        { t.is_ready() } -> std::convertible_to<bool>;
+    }
+struct asset_ready {
+    asset_ready(const T *asset) : asset(asset) {}
+    asset_ready(const std::shared_ptr<T> &asset) : asset(asset.get()) {}
+    bool await_ready() const { return is_done(asset); }
+    void await_suspend(std::coroutine_handle<task::promise_type> h) const {
+        h.promise().scheduler->wait_for(h.promise(), asset, is_done);
+    }
+    void await_resume() const {
+        if (!asset->is_ready()) {
+            throw std::runtime_error("Could not load the asset a task awaited");
+        }
+    }
+    static bool is_done(const void *a) {
+        const T *asset = static_cast<const T *>(a);
+        if constexpr (requires { asset->has_failed(); }) {
+            return asset->is_ready() || asset->has_failed();
+        } else {
+            return asset->is_ready();
+        }
+    }
+    const T *asset;
+};
+// co_await job_done(app::jobs().submit(job)) resumes the task once the job has finished and returns its result, or
+// rethrows its exception
+template <typename T> struct job_done {
+    job_done(std::future<T> &&job) : job(std::move(job)) {}
+    bool await_ready() const { return is_done(&job); }
+    void await_suspend(std::coroutine_handle<task::promise_type> h) const {
+        h.promise().scheduler->wait_for(h.promise(), &job, is_done);
+    }
+    T await_resume() { return job.get(); }
+    static bool is_done(const void *job) {
+        return static_cast<const std::future<T> *>(job)->wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+    std::future<T> job;
+};
+} // namespace square
@@ -0,0 +1,129 @@
+module;
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stop_token>
+#include <thread>
+#include <type_traits>
+#include <vector>
+export module square:thread_pool;
+
+export namespace square {
+// A fixed size pool of worker threads that run jobs in the order they were submitted.
+//
+// No rendering context is current on the worker threads, so jobs must not call into a rendering API. Jobs that are
+// still queued when the pool is destroyed are discarded.
+class thread_pool {
+  public:
+    // construct a pool with thread_count workers. If thread_count is zero, one worker per hardware thread is created
+    // leaving one hardware thread for the main thread.
+    thread_pool(unsigned int thread_count = 0) {
+        if (thread_count == 0) {
+            unsigned int hardware_threads = std::thread::hardware_concurrency();
+            thread_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+        }
+        workers.reserve(thread_count);
+        for (unsigned int i = 0; i < thread_count; i++) {
+            workers.emplace_back([this](std::stop_token stop) { work(stop); });
+        }
+    }
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+    ~thread_pool() {
+        // the workers must be joined before the queue they wait on is destroyed
+        for (auto &worker : workers) {
+            worker.request_stop();
+        }
+        workers.clear();
+    }
+    // queue a job to run on a worker thread. The returned future holds the result of the job or the exception it threw.
+    template <typename F> std::future<std::invoke_result_t<F>> submit(F &&job) {
+        auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(job));
+        auto result = task->get_future();
+        {
+            std::lock_guard lock(queue_mutex);
+            jobs.emplace([task]() { (*task)(); });
+        }
+        queue_cv.notify_one();
+        return result;
+    }
+    inline size_t size() const { return workers.size(); }
+
+  private:
+    void work(std::stop_token stop) {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock lock(queue_mutex);
+                if (!queue_cv.wait(lock, stop, [this]() { return !jobs.empty(); })) {
+                    return; // stop was requested
+                }
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+    std::mutex queue_mutex;
+    std::condition_variable_any queue_cv;
+    std::queue<std::function<void()>> jobs;
+    std::vector<std::jthread> workers;
+};
+// Call body(i) for each i below count on jobs of the pool and the calling thread, and return when every call is done.
+// in_job(job) calls job() on a worker thread, e.g. to give it the active renderer of the calling thread. Rethrows the
+// first exception thrown by body().
+//
+// The calling thread takes indices too and only waits for the calls the jobs have started, so this can't wait on jobs
+// queued behind the caller, e.g. when the caller is itself a job.
+template <typename J, typename F> void parallel_for(thread_pool &pool, size_t count, J &&in_job, F &&body) {
+    if (count <= 1) {
+        if (count == 1) {
+            body(size_t{0});
+        }
+        return;
+    }
+    // jobs that start after every index was taken return without touching body, which may be gone by then
+    struct shared_state {
+        std::function<void(size_t)> body;
+        size_t count;
+        std::atomic<size_t> next = 0;
+        std::atomic<size_t> finished = 0;
+        std::mutex error_mutex;
+        std::exception_ptr error = nullptr;
+    };
+    auto state = std::make_shared<shared_state>();
+    state->body = std::ref(body);
+    state->count = count;
+    auto take_indices = [](shared_state &s) {
+        for (size_t i = s.next++; i < s.count; i = s.next++) {
+            try {
+                s.body(i);
+            } catch (...) {
+                std::lock_guard lock(s.error_mutex);
+                if (!s.error) {
+                    s.error = std::current_exception();
+                }
+            }
+            if (++s.finished == s.count) {
+                s.finished.notify_all();
+            }
+        }
+    };
+    for (size_t i = 0; i < std::min(count - 1, pool.size()); i++) {
+        pool.submit([state, take_indices, in_job]() { in_job([&]() { take_indices(*state); }); });
+    }
+    take_indices(*state);
+    for (size_t done = state->finished; done < count; done = state->finished) {
+        state->finished.wait(done);
+    }
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+} // namespace square
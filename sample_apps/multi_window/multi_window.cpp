@@ -62,6 +62,8 @@ class main_renderer : public sdl_gl_renderer {
         properties.window_title = "untitled";
         properties.window_width = 1280;
         properties.window_height = 720;
+        // each window renders on its own thread so the windows don't wait for each other's buffer swaps
+        properties.threaded = true;
         scene = gen_object<main_scene>();
     }
     void on_enter() override {
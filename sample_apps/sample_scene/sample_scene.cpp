@@ -1,5 +1,5 @@
 // A sample app showing a torus with a checkerboard texture where a perspective projection camera orbits the mesh.
-// Pressing the 'T' key will toggle wireframe mode
+// Pressing the 'T' key will toggle wireframe mode and pressing 'F3' will toggle the performance HUD
 #include <memory>
 import square;
 import squint;
@@ -26,12 +26,13 @@ class sample_obj : public entity<sample_obj> {
     sample_obj(basic_texture *mat) : mat(mat) { attach_render_system<sample_obj_render_system>(); }
     void on_enter() override {
         mesh = std::move(std::make_unique<torus_mesh>(100, 200, 0.5f, 1.0f));
-        checkerboard_tex = app::renderer()->gen_texture("textures/checkerboard.png");
+        // the texture is loaded in the background and shared with every object that loads the same file
+        checkerboard_tex = app::renderer()->load_texture("textures/checkerboard.png");
         mesh->bind_material(mat);
     }
     basic_texture *mat;
     std::unique_ptr<torus_mesh> mesh;
-    std::unique_ptr<texture2D> checkerboard_tex;
+    std::shared_ptr<texture2D> checkerboard_tex;
 };
 
 // LAYER ---------------------------------------------------------------------------------------------------------------
@@ -70,9 +71,10 @@ template <typename T> class sample_scene_controls_system : public controls_syste
         static bool enabled = false;
         if (event == key_event::T_DOWN) {
             enabled = !enabled;
+            app::renderer()->wireframe_mode(enabled);
+            return true;
         }
-        app::renderer()->wireframe_mode(enabled);
-        return true;
+        return false;
     }
 };
 // The scene that containes the object to be rendered
@@ -83,6 +85,8 @@ class sample_scene : public entity<sample_scene> {
         // we create the material here and add all objects that will be rendered with that material
         auto mat = gen_object<basic_texture>(cam);
         mat->attach_object<sample_obj>(mat);
+        // the performance HUD is drawn last so it is drawn over the scene. Press F3 to show it.
+        gen_object<perf_hud>(aspect);
         // generate and attach the systems
         attach_render_system<sample_scene_render_system>();
         attach_physics_system<sample_scene_physics_system>();
@@ -0,0 +1,363 @@
+// A stress test app that builds synthetic scenes of increasing size and reports how frame times and render counters
+// scale with the number of entities.
+//
+// Usage: stress_scene [key=value ...]
+//
+//   entities=100,1000,10000,100000  number of textured quads in the scene
+//   materials=1                      number of materials the entities are split between
+//   textures=1                       number of textures each material's entities are split between
+//   instanced=0,1                    draw every entity separately (0) or one instanced draw per texture (1)
+//   fan_out=8                        children per entity in the object tree, the depth grows with log(entities)
+//   pipelined=0                      update on the render thread (0) or on a job while the last update renders (1)
+//   parallel=0                       run the physics systems in order (0) or in parallel by their declared access (1)
+//   packets=0                        draw each entity from its render system (0) or record the draws of entities
+//                                    that aren't instanced into a draw_list on the job threads and submit it (1)
+//   frames=120                       frames measured per scene, after warmup frames
+//   warmup=10                        frames run before measuring, e.g. while textures are uploaded
+//   out=stress.csv                   write the results to a CSV file instead of stdout
+//
+// A scene is run for every combination of the listed values, each in its own headless renderer. Every entity rotates in
+// its physics system so the object tree is traversed in both update and render.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+import square;
+import squint;
+
+using namespace square;
+using namespace squint;
+using namespace squint::quantities;
+
+// CONFIGURATION -------------------------------------------------------------------------------------------------------
+struct stress_config {
+    size_t entities;
+    size_t materials;
+    size_t textures;
+    bool instanced;
+    size_t fan_out;
+    bool pipelined;
+    bool parallel;
+    bool packets;
+};
+struct stress_result {
+    stress_config config;
+    size_t depth;
+    size_t frames;
+    percentile_summary frame;
+    percentile_summary update;
+    percentile_summary render;
+    render_stats stats;
+};
+
+// SCENE ---------------------------------------------------------------------------------------------------------------
+class stress_node;
+// The nodes drawn with one material. Owns the quad mesh bound to the material, or one instanced quad mesh per texture
+// when the scene is instanced.
+class stress_group : public entity<stress_group> {
+  public:
+    stress_group(basic_texture *mat, const std::vector<std::unique_ptr<texture2D>> *textures, bool instanced,
+                 bool packets)
+        : mat(mat), textures(textures), instanced(instanced), packets(packets && !instanced) {}
+    void on_enter() override {
+        if (instanced) {
+            for (size_t i = 0; i < textures->size(); i++) {
+                // nodes are assigned textures round robin
+                auto count = static_cast<unsigned int>(
+                    std::max<size_t>((node_count + textures->size() - 1 - i) / textures->size(), 1));
+                batches.push_back(std::make_unique<instanced_mesh>(std::make_unique<square_mesh>(), count));
+                batches.back()->bind_material(mat);
+            }
+        } else {
+            quad = std::make_unique<square_mesh>();
+            quad->bind_material(mat);
+        }
+    }
+    void on_exit() override {
+        quad.reset();
+        batches.clear();
+    }
+    void draw(size_t texture, const transform &model) {
+        if (instanced) {
+            batches[texture]->push_instance(model);
+        } else {
+            mat->set_texture((*textures)[texture].get());
+            quad->draw(mat, &model);
+        }
+    }
+    // draw the instances pushed by the nodes, or record and submit the draws of the nodes with packets
+    void flush();
+    basic_texture *mat;
+    const std::vector<std::unique_ptr<texture2D>> *textures;
+    bool instanced;
+    bool packets;
+    size_t node_count = 0;
+    std::vector<stress_node *> nodes; // the nodes of the group with packets, which have no render system
+
+  private:
+    std::unique_ptr<square_mesh> quad;
+    std::vector<std::unique_ptr<instanced_mesh>> batches;
+    draw_list draws;
+};
+// A textured quad. Nodes are placed on a grid filling the view and are not transformed by their parents, the object
+// tree only determines the traversal.
+template <typename T> class stress_node_physics_system : public physics_system<T> {
+  public:
+    void update(time_f dt, T &node) const override {
+        node.model.write().rotate(fvec3({0.f, 0.f, 1.f}), node.speed * dt.as_seconds());
+    }
+    // nodes only change their own transform so they can be updated in parallel
+    const system_access *get_access() const override {
+        static const system_access access = system_access().writes<transform>();
+        return &access;
+    }
+};
+template <typename T> class stress_node_render_system : public render_system<T> {
+  public:
+    void render(time_f dt, T &node) const override { node.group->draw(node.texture, node.model.read()); }
+};
+class stress_node : public entity<stress_node> {
+  public:
+    stress_node(stress_group *group, size_t texture, const fmat4 &model, float speed)
+        : group(group), texture(texture), model(model), speed(speed) {
+        attach_physics_system<stress_node_physics_system>();
+        if (group->packets) {
+            group->nodes.push_back(this);
+        } else {
+            attach_render_system<stress_node_render_system>();
+        }
+    }
+    stress_group *group;
+    size_t texture;
+    double_buffered<transform> model;
+    float speed;
+};
+void stress_group::flush() {
+    if (packets) {
+        draws.clear();
+        draws.record_parallel(nodes.size(), [this](size_t begin, size_t end, draw_list &list) {
+            for (size_t i = begin; i < end; i++) {
+                list.set_texture((*textures)[nodes[i]->texture].get());
+                quad->record(list, mat, &nodes[i]->model.read());
+            }
+        });
+        draws.submit();
+        return;
+    }
+    for (size_t i = 0; i < batches.size(); i++) {
+        if (batches[i]->get_instance_count() > 0) {
+            mat->set_texture((*textures)[i].get());
+            batches[i]->draw(mat);
+            batches[i]->clear_instances();
+        }
+    }
+}
+// Draws the instances pushed by the nodes of a group. It is the last child of the group so it renders after them.
+template <typename T> class stress_batch_render_system : public render_system<T> {
+  public:
+    void render(time_f dt, T &batch) const override { batch.group->flush(); }
+};
+class stress_batch : public entity<stress_batch> {
+  public:
+    stress_batch(stress_group *group) : group(group) { attach_render_system<stress_batch_render_system>(); }
+    stress_group *group;
+};
+template <typename T> class stress_scene_render_system : public render_system<T> {
+  public:
+    void render(time_f dt, T &scene) const override {
+        renderer *r = app::renderer();
+        r->enable_depth_testing(false);
+        r->enable_face_culling(false);
+        r->clear_color_buffer({0.1f, 0.1f, 0.1f, 1.0f});
+        // the frame, update and render times of the measured frames are recorded by the start of the next frame, when
+        // the frame time windows no longer hold any warmup frames
+        if (++scene.frame_count == scene.warmup_frames + scene.measured_frames + 1) {
+            scene.results->push_back({scene.config, scene.depth, scene.measured_frames, r->get_frame_times().summary(),
+                                      r->get_update_times().summary(), r->get_render_times().summary(),
+                                      r->get_stats()});
+            r->destroy();
+        }
+    }
+};
+class stress_scene : public entity<stress_scene> {
+  public:
+    stress_scene(const stress_config &config, size_t warmup_frames, size_t measured_frames,
+                 std::vector<stress_result> *results, float aspect)
+        : config(config), warmup_frames(warmup_frames), measured_frames(measured_frames), results(results) {
+        attach_render_system<stress_scene_render_system>();
+        cam = gen_object<camera>(projection_type::ORTHOGRAPHIC, aspect);
+        size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(config.entities))));
+        float spacing = 2.f / static_cast<float>(side);
+        size_t next = 0;
+        // place the node with the next index on the grid and spin it at a speed depending on its index
+        auto gen_node = [&](object *parent, stress_group *group, size_t index) {
+            fvec3 position({-aspect + spacing * (0.5f + static_cast<float>(next % side)) * aspect,
+                            -1.f + spacing * (0.5f + static_cast<float>(next / side)), 0.f});
+            fvec3 size({0.8f * spacing, 0.8f * spacing, 1.f});
+            fmat4 model = squint::scale(squint::translate(fmat4::I(), position), size);
+            next++;
+            return parent->gen_object<stress_node>(group, index % config.textures, model, 0.5f + (next % 7) * 0.25f);
+        };
+        for (size_t m = 0; m < config.materials; m++) {
+            auto mat = gen_object<basic_texture>(cam);
+            auto group = mat->gen_object<stress_group>(mat, &textures, config.instanced, config.packets);
+            group->node_count = config.entities / config.materials + (m < config.entities % config.materials ? 1 : 0);
+            if (group->node_count == 0) {
+                continue;
+            }
+            // build the group's tree breadth first
+            std::deque<std::pair<stress_node *, size_t>> parents{{gen_node(group, group, 0), 1}};
+            size_t count = 1;
+            depth = std::max<size_t>(depth, 1);
+            while (count < group->node_count) {
+                auto [parent, parent_depth] = parents.front();
+                parents.pop_front();
+                for (size_t i = 0; i < config.fan_out && count < group->node_count; i++, count++) {
+                    parents.push_back({gen_node(parent, group, count), parent_depth + 1});
+                    depth = std::max(depth, parent_depth + 1);
+                }
+            }
+            group->gen_object<stress_batch>(group);
+        }
+    }
+    void on_enter() override {
+        // every texture is a separate GL texture even though they are read from the same image
+        for (size_t i = 0; i < config.textures; i++) {
+            textures.push_back(app::renderer()->gen_texture("textures/checkerboard.png"));
+        }
+    }
+    void on_exit() override { textures.clear(); }
+    stress_config config;
+    size_t warmup_frames;
+    size_t measured_frames;
+    std::vector<stress_result> *results;
+    size_t frame_count = 0;
+    size_t depth = 0;
+
+  private:
+    camera *cam;
+    std::vector<std::unique_ptr<texture2D>> textures;
+};
+
+// RENDERER ------------------------------------------------------------------------------------------------------------
+// runs one scene offscreen and detaches itself when the scene has been measured
+class stress_renderer : public sdl_gl_renderer {
+  public:
+    stress_renderer(const stress_config &config, size_t warmup_frames, size_t measured_frames,
+                    std::vector<stress_result> *results) {
+        properties.window_title = "stress_scene";
+        properties.window_width = 1280;
+        properties.window_height = 720;
+        properties.headless = true;
+        properties.debug = debug_mode::OFF;
+        properties.frame_time_window = measured_frames;
+        properties.pipelined_update = config.pipelined;
+        properties.parallel_systems = config.parallel;
+        float aspect = float(properties.window_width) / float(properties.window_height);
+        scene = gen_object<stress_scene>(config, warmup_frames, measured_frames, results, aspect);
+    }
+    void on_enter() override { load_object(scene); }
+    stress_scene *scene;
+};
+
+// REPORT --------------------------------------------------------------------------------------------------------------
+void write_csv(std::ostream &os, const std::vector<stress_result> &results) {
+    auto ms = [](time_f t) { return t.as_seconds() * 1000.f; };
+    os << "entities,materials,textures,instanced,fan_out,pipelined,parallel,packets,depth,frames,"
+          "frame_p50_ms,frame_p95_ms,frame_p99_ms,frame_max_ms,update_p50_ms,update_p99_ms,render_p50_ms,"
+          "render_p99_ms,frame_p50_ns_per_entity,draw_calls,instanced_draw_calls,instances,primitives,program_binds,"
+          "vertex_array_binds,texture_binds,storage_buffer_binds,uniform_uploads,buffer_bytes_written\n";
+    for (const auto &result : results) {
+        const stress_config &c = result.config;
+        const render_stats &s = result.stats;
+        os << c.entities << "," << c.materials << "," << c.textures << "," << c.instanced << "," << c.fan_out << ","
+           << c.pipelined << "," << c.parallel << "," << c.packets << "," << result.depth << "," << result.frames << ","
+           << ms(result.frame.p50) << "," << ms(result.frame.p95) << "," << ms(result.frame.p99) << ","
+           << ms(result.frame.max) << "," << ms(result.update.p50) << "," << ms(result.update.p99) << ","
+           << ms(result.render.p50) << "," << ms(result.render.p99) << ","
+           << result.frame.p50.as_seconds() * 1e9 / static_cast<double>(c.entities) << "," << s.draw_calls << ","
+           << s.instanced_draw_calls << "," << s.instances << "," << s.primitives << "," << s.program_binds << ","
+           << s.vertex_array_binds << "," << s.texture_binds << "," << s.storage_buffer_binds << ","
+           << s.uniform_uploads << "," << s.buffer_bytes_written << "\n";
+    }
+}
+std::vector<size_t> parse_list(const std::string &value) {
+    std::vector<size_t> list{};
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        list.push_back(std::stoull(item));
+    }
+    return list;
+}
+
+int main(int argc, char **argv) {
+    std::map<std::string, std::string> args{{"entities", "100,1000,10000,100000"},
+                                            {"materials", "1"},
+                                            {"textures", "1"},
+                                            {"instanced", "0,1"},
+                                            {"fan_out", "8"},
+                                            {"pipelined", "0"},
+                                            {"parallel", "0"},
+                                            {"packets", "0"},
+                                            {"frames", "120"},
+                                            {"warmup", "10"},
+                                            {"out", ""}};
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos || !args.contains(arg.substr(0, eq))) {
+            std::cerr << "unknown argument " << arg << std::endl;
+            return 1;
+        }
+        args[arg.substr(0, eq)] = arg.substr(eq + 1);
+    }
+    size_t frames = std::max<size_t>(std::stoull(args["frames"]), 1);
+    size_t warmup = std::stoull(args["warmup"]);
+    std::vector<stress_config> configs{};
+    for (size_t materials : parse_list(args["materials"])) {
+        for (size_t textures : parse_list(args["textures"])) {
+            for (size_t instanced : parse_list(args["instanced"])) {
+                for (size_t fan_out : parse_list(args["fan_out"])) {
+                    for (size_t pipelined : parse_list(args["pipelined"])) {
+                        for (size_t parallel : parse_list(args["parallel"])) {
+                            for (size_t packets : parse_list(args["packets"])) {
+                                for (size_t entities : parse_list(args["entities"])) {
+                                    configs.push_back({entities, std::max<size_t>(materials, 1),
+                                                       std::max<size_t>(textures, 1), instanced != 0,
+                                                       std::max<size_t>(fan_out, 1), pipelined != 0, parallel != 0,
+                                                       packets != 0});
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    std::vector<stress_result> results{};
+    sdl_gl_renderer::init(true);
+    for (const auto &config : configs) {
+        std::cerr << "entities " << config.entities << " materials " << config.materials << " textures "
+                  << config.textures << " instanced " << config.instanced << " fan_out " << config.fan_out
+                  << " pipelined " << config.pipelined << " parallel " << config.parallel << " packets "
+                  << config.packets << std::endl;
+        app::attach_renderer<stress_renderer>(config, warmup, frames, &results);
+        app::run();
+    }
+    sdl_gl_renderer::quit();
+    if (args["out"].empty()) {
+        write_csv(std::cout, results);
+    } else {
+        std::ofstream file(args["out"]);
+        write_csv(file, results);
+    }
+    return 0;
+}
@@ -13,9 +13,19 @@ export import :mesh;
 export import :transform;
 export import :basic_color;
 export import :basic_texture;
+export import :basic_texture_array;
 export import :camera;
+export import :perf_hud;
 export import :material;
 export import :entity;
 export import :renderer;
 export import :sdl_gl;
-export import :system;
\ No newline at end of file
+export import :system;
+export import :thread_pool;
+export import :profiler;
+export import :histogram;
+export import :dynamic_resolution;
+export import :frame_pacer;
+export import :double_buffered;
+export import :task;
+export import :system_scheduler;
\ No newline at end of file
@@ -0,0 +1,337 @@
+// Golden image tests. Each test renders a small scene headlessly for a fixed number of frames, reads back the
+// framebuffer and compares it to a reference image in tests/golden. The frame times and render counters of the last
+// frame are compared to a baseline stored next to the image so optimizations that change what is drawn, or that draw
+// more than before, are caught.
+//
+// Run with SQUARE_UPDATE_GOLDEN=1 to write the reference images and baselines instead of comparing against them. A
+// test without a reference image or baseline fails, so only the tests of scenes with a committed reference image are
+// registered with CTest. Each test is tagged with the name of its image.
+// Frame times depend on the machine so they are only checked when SQUARE_GOLDEN_TIME_TOLERANCE is set, e.g. to 1.25
+// to fail when the median frame time is more than 25% slower than the baseline.
+#include <SDL.h>
+#include <SDL_image.h>
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+import square;
+import squint;
+
+using namespace square;
+using namespace squint;
+using namespace squint::quantities;
+
+// SCENES --------------------------------------------------------------------------------------------------------------
+// Scenes only move in their physics systems, which are updated with the fixed time step, so every run renders the
+// same frames.
+template <typename T> class golden_clear_render_system : public render_system<T> {
+  public:
+    void render(time_f dt, T &scene) const override {
+        renderer *r = app::renderer();
+        r->enable_depth_testing(true);
+        r->enable_face_culling(true);
+        r->clear_color_buffer(scene.bg_color);
+        r->clear_depth_buffer();
+    }
+};
+class solid_color_scene : public entity<solid_color_scene> {
+  public:
+    solid_color_scene(float aspect) { attach_render_system<golden_clear_render_system>(); }
+    fvec4 bg_color = color::parse_hexcode("E67825");
+};
+template <typename T> class golden_mesh_render_system : public render_system<T> {
+  public:
+    void render(time_f dt, T &obj) const override {
+        obj.prepare();
+        obj.mat->set_model(obj.mesh.get());
+        obj.mesh->draw(obj.mat);
+    }
+};
+template <typename T> class golden_spin_physics_system : public physics_system<T> {
+  public:
+    void update(time_f dt, T &obj) const override { obj.mesh->rotate(fvec3({0.f, 1.f, 0.f}), dt.as_seconds()); }
+};
+class triangle_obj : public entity<triangle_obj> {
+  public:
+    triangle_obj(basic_color *mat) : mat(mat) { attach_render_system<golden_mesh_render_system>(); }
+    void on_enter() override {
+        mesh = std::make_unique<triangle_mesh>(fvec2({-1.f, -1.f}), fvec2({1.f, -1.f}), fvec2({0.f, 1.f}));
+        mesh->bind_material(mat);
+    }
+    void prepare() { mat->set_color(color::parse_hexcode("E67825")); }
+    basic_color *mat;
+    std::unique_ptr<triangle_mesh> mesh;
+};
+class torus_obj : public entity<torus_obj> {
+  public:
+    torus_obj(basic_texture *mat) : mat(mat) {
+        attach_physics_system<golden_spin_physics_system>();
+        attach_render_system<golden_mesh_render_system>();
+    }
+    void on_enter() override {
+        mesh = std::make_unique<torus_mesh>(50, 100, 0.5f, 1.0f);
+        mesh->bind_material(mat);
+        // loaded synchronously so every frame is textured
+        tex = app::renderer()->gen_texture("textures/checkerboard.png");
+    }
+    void on_exit() override {
+        mesh.reset();
+        tex.reset();
+    }
+    void prepare() { mat->set_texture(tex.get()); }
+    basic_texture *mat;
+    std::unique_ptr<torus_mesh> mesh;
+    std::unique_ptr<texture2D> tex;
+};
+// a perspective scene of a single object viewed from a fixed camera
+template <typename M, typename O> class object_scene : public entity<object_scene<M, O>> {
+  public:
+    object_scene(float aspect) {
+        this->template attach_render_system<golden_clear_render_system>();
+        auto cam = this->template gen_object<camera>(projection_type::PERSPECTIVE, aspect);
+        tensor<length_f, 3> position{};
+        position[1] = length_f::meters(1.5f);
+        position[2] = length_f::meters(3.f);
+        cam->set_position(position);
+        cam->face_towards(tensor<length_f, 3>{}, {0.f, 1.f, 0.f});
+        auto mat = this->template gen_object<M>(cam);
+        mat->template attach_object<O>(mat);
+    }
+    fvec4 bg_color = color::parse_hexcode("1A1A1A");
+};
+using triangle_scene = object_scene<basic_color, triangle_obj>;
+using torus_scene = object_scene<basic_texture, torus_obj>;
+template <typename T> class golden_overlay_render_system : public render_system<T> {
+  public:
+    void render(time_f dt, T &obj) const override {
+        app::renderer()->enable_face_culling(false);
+        obj.mat->set_color(color::parse_hexcode("FFFFFF"));
+        obj.text->draw(obj.mat);
+        obj.mat->set_color(color::parse_hexcode("33CC55"));
+        obj.quads->draw(obj.mat);
+    }
+};
+// text and an instanced grid of quads drawn with an orthographic camera
+class overlay_obj : public entity<overlay_obj> {
+  public:
+    overlay_obj(basic_color *mat) : mat(mat) { attach_render_system<golden_overlay_render_system>(); }
+    void on_enter() override {
+        text = std::make_unique<char_mesh>("SQUARE 0123456789\nthe quick brown fox", 0.f, 0.f, 1024);
+        text->bind_material(mat);
+        text->set_transformation_matrix(squint::scale(
+            squint::translate(fmat4::I(), fvec3({-1.2f, 0.8f, 0.f})), fvec3({0.1f, 0.1f, 1.f})));
+        quads = std::make_unique<instanced_mesh>(std::make_unique<square_mesh>(), grid_size * grid_size);
+        quads->bind_material(mat);
+        for (unsigned int i = 0; i < grid_size * grid_size; i++) {
+            fvec3 position({-0.6f + 0.08f * (i % grid_size), -0.8f + 0.08f * (i / grid_size), 0.f});
+            quads->push_instance(transform(squint::scale(squint::translate(fmat4::I(), position),
+                                                         fvec3({0.05f, 0.05f, 1.f}))));
+        }
+    }
+    void on_exit() override {
+        text.reset();
+        quads.reset();
+    }
+    inline static constexpr unsigned int grid_size = 16;
+    basic_color *mat;
+    std::unique_ptr<char_mesh> text;
+    std::unique_ptr<instanced_mesh> quads;
+};
+class overlay_scene : public entity<overlay_scene> {
+  public:
+    overlay_scene(float aspect) {
+        attach_render_system<golden_clear_render_system>();
+        auto cam = gen_object<camera>(projection_type::ORTHOGRAPHIC, aspect);
+        auto mat = gen_object<basic_color>(cam);
+        mat->attach_object<overlay_obj>(mat);
+    }
+    fvec4 bg_color = color::parse_hexcode("000000");
+};
+
+// HARNESS -------------------------------------------------------------------------------------------------------------
+template <typename S> class golden_renderer : public sdl_gl_renderer {
+  public:
+    golden_renderer() {
+        properties.window_title = "golden";
+        properties.window_width = 320;
+        properties.window_height = 240;
+        properties.headless = true;
+        // multisampling patterns differ between drivers
+        properties.samples = 1;
+        properties.debug = debug_mode::HIGH;
+        scene = gen_object<S>(float(properties.window_width) / float(properties.window_height));
+    }
+    void on_enter() override { load_object(scene); }
+    S *scene;
+};
+// SDL is initialized for the duration of a test
+struct headless_session {
+    headless_session() { sdl_gl_renderer::init(true); }
+    ~headless_session() { sdl_gl_renderer::quit(); }
+};
+struct golden_capture {
+    framebuffer_image image;
+    percentile_summary frame_times;
+    render_stats stats;
+};
+template <typename S> golden_capture capture(size_t frames) {
+    app::attach_renderer<golden_renderer<S>>();
+    REQUIRE(app::run_frames(frames) == frames);
+    renderer *r = app::get_renderers().back().get();
+    golden_capture result{r->read_framebuffer(), r->get_frame_times().summary(), r->get_stats()};
+    r->destroy();
+    app::run();
+    return result;
+}
+void save_png(const framebuffer_image &image, const std::filesystem::path &path) {
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(
+        const_cast<uint8_t *>(image.pixels.data()), static_cast<int>(image.width), static_cast<int>(image.height), 32,
+        static_cast<int>(image.width * 4), SDL_PIXELFORMAT_RGBA32);
+    if (!surface || IMG_SavePNG(surface, path.string().c_str()) != 0) {
+        SDL_FreeSurface(surface);
+        throw std::runtime_error("Could not write image " + path.string() + ": " + IMG_GetError());
+    }
+    SDL_FreeSurface(surface);
+}
+framebuffer_image load_png(const std::filesystem::path &path) {
+    SDL_Surface *loaded = IMG_Load(path.string().c_str());
+    if (!loaded) {
+        throw std::runtime_error("Could not read image " + path.string() + ": " + IMG_GetError());
+    }
+    SDL_Surface *surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(loaded);
+    if (!surface) {
+        throw std::runtime_error("Could not convert image " + path.string() + ": " + SDL_GetError());
+    }
+    framebuffer_image image{static_cast<uint32_t>(surface->w), static_cast<uint32_t>(surface->h), {}};
+    image.pixels.resize(static_cast<size_t>(image.width) * image.height * 4);
+    for (uint32_t row = 0; row < image.height; row++) {
+        const auto *src = static_cast<const uint8_t *>(surface->pixels) + static_cast<size_t>(row) * surface->pitch;
+        std::copy(src, src + image.width * 4, image.pixels.begin() + static_cast<size_t>(row) * image.width * 4);
+    }
+    SDL_FreeSurface(surface);
+    return image;
+}
+// frame times in milliseconds and the render counters of a capture, stored as a flat JSON object
+std::vector<std::pair<std::string, double>> baseline_values(const golden_capture &capture) {
+    const render_stats &s = capture.stats;
+    return {{"frame_p50_ms", capture.frame_times.p50.as_seconds() * 1000.0},
+            {"frame_p99_ms", capture.frame_times.p99.as_seconds() * 1000.0},
+            {"draw_calls", double(s.draw_calls)},
+            {"instanced_draw_calls", double(s.instanced_draw_calls)},
+            {"instances", double(s.instances)},
+            {"primitives", double(s.primitives)},
+            {"program_binds", double(s.program_binds)},
+            {"vertex_array_binds", double(s.vertex_array_binds)},
+            {"texture_binds", double(s.texture_binds)},
+            {"storage_buffer_binds", double(s.storage_buffer_binds)},
+            {"uniform_uploads", double(s.uniform_uploads)}};
+}
+void save_baseline(const golden_capture &capture, const std::filesystem::path &path) {
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Could not write baseline " + path.string());
+    }
+    auto values = baseline_values(capture);
+    file << "{";
+    for (size_t i = 0; i < values.size(); i++) {
+        file << (i == 0 ? "\n" : ",\n") << "  \"" << values[i].first << "\": " << values[i].second;
+    }
+    file << "\n}\n";
+}
+// the value of a key in a baseline written by save_baseline, or a negative value if the key is missing
+double baseline_value(const std::string &baseline, const std::string &key) {
+    size_t pos = baseline.find("\"" + key + "\":");
+    if (pos == std::string::npos) {
+        return -1.0;
+    }
+    return std::strtod(baseline.c_str() + pos + key.size() + 3, nullptr);
+}
+// Compare a capture to its reference image and baseline, or replace them when SQUARE_UPDATE_GOLDEN is set.
+//
+// A pixel differs when any channel differs by more than channel_tolerance, which absorbs rounding differences
+// between drivers. The test fails when more than pixel_tolerance of the pixels differ.
+void check_golden(const std::string &name, const golden_capture &capture, int channel_tolerance = 8,
+                  double pixel_tolerance = 0.002) {
+    std::filesystem::path directory = "tests/golden";
+    std::filesystem::path image_path = directory / (name + ".png");
+    std::filesystem::path baseline_path = directory / (name + ".json");
+    if (std::getenv("SQUARE_UPDATE_GOLDEN")) {
+        std::filesystem::create_directories(directory);
+        save_png(capture.image, image_path);
+        save_baseline(capture, baseline_path);
+        WARN("updated " << image_path.string() << " and " << baseline_path.string());
+        return;
+    }
+    // a missing reference fails, otherwise a test would pass without comparing anything
+    if (!std::filesystem::exists(image_path)) {
+        FAIL("no reference image " << image_path.string() << ", run with SQUARE_UPDATE_GOLDEN=1 to create it");
+    }
+    framebuffer_image reference = load_png(image_path);
+    REQUIRE(reference.width == capture.image.width);
+    REQUIRE(reference.height == capture.image.height);
+    size_t differing_pixels = 0;
+    for (size_t i = 0; i < reference.pixels.size(); i += 4) {
+        for (size_t c = 0; c < 4; c++) {
+            if (std::abs(int(reference.pixels[i + c]) - int(capture.image.pixels[i + c])) > channel_tolerance) {
+                differing_pixels++;
+                break;
+            }
+        }
+    }
+    double differing_fraction = double(differing_pixels) / double(reference.pixels.size() / 4);
+    if (differing_fraction > pixel_tolerance) {
+        // keep the output so it can be inspected
+        std::filesystem::path actual_path = std::filesystem::temp_directory_path() / ("square_" + name + ".png");
+        save_png(capture.image, actual_path);
+        INFO("rendered image written to " << actual_path.string());
+        CHECK(differing_fraction <= pixel_tolerance);
+    }
+    std::ifstream file(baseline_path);
+    if (!file) {
+        FAIL("no baseline " << baseline_path.string() << ", run with SQUARE_UPDATE_GOLDEN=1 to create it");
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    std::string baseline = ss.str();
+    for (const auto &[key, value] : baseline_values(capture)) {
+        double expected = baseline_value(baseline, key);
+        INFO(key << " " << value << " baseline " << expected);
+        if (key.ends_with("_ms")) {
+            if (const char *tolerance = std::getenv("SQUARE_GOLDEN_TIME_TOLERANCE")) {
+                REQUIRE(expected >= 0.0);
+                CHECK(value <= expected * std::strtod(tolerance, nullptr));
+            }
+        } else {
+            REQUIRE(expected >= 0.0);
+            // doing less work than the baseline is fine
+            CHECK(value <= expected);
+        }
+    }
+}
+
+// TESTS ---------------------------------------------------------------------------------------------------------------
+constexpr size_t golden_frames = 60;
+TEST_CASE("solid color scene matches its golden image", "[golden][solid_color]") {
+    headless_session session;
+    check_golden("solid_color", capture<solid_color_scene>(golden_frames));
+}
+TEST_CASE("triangle scene matches its golden image", "[golden][triangle]") {
+    headless_session session;
+    check_golden("triangle", capture<triangle_scene>(golden_frames));
+}
+TEST_CASE("textured torus scene matches its golden image", "[golden][torus]") {
+    headless_session session;
+    check_golden("torus", capture<torus_scene>(golden_frames));
+}
+TEST_CASE("text and instanced overlay scene matches its golden image", "[golden][overlay]") {
+    headless_session session;
+    check_golden("overlay", capture<overlay_scene>(golden_frames));
+}
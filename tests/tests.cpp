@@ -1,5 +1,380 @@
 #include <catch2/catch_test_macros.hpp>
-#include <iostream>
-TEST_CASE("test1", "[test1]") {
-    SECTION("test") { std::cout << "test" << std::endl; }
-}
\ No newline at end of file
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+import square;
+import squint;
+
+using namespace square;
+using namespace squint::quantities;
+
+// HISTOGRAM -----------------------------------------------------------------------------------------------------------
+double as_nanoseconds(time_f t) { return static_cast<double>(t.as_seconds()) * 1e9; }
+// durations are stored as float seconds
+void check_near(time_f duration, double ns) {
+    INFO("duration " << as_nanoseconds(duration) << " ns, expected " << ns << " ns");
+    CHECK(std::abs(as_nanoseconds(duration) - ns) <= ns * 1e-6);
+}
+// percentiles are rounded up to the upper edge of their bucket, at most 12.5% above the sample
+void check_percentile(time_f percentile, double sample_ns) {
+    INFO("percentile " << as_nanoseconds(percentile) << " ns, sample " << sample_ns << " ns");
+    CHECK(as_nanoseconds(percentile) >= sample_ns * (1.0 - 1e-6));
+    CHECK(as_nanoseconds(percentile) <= sample_ns * 1.125 * (1.0 + 1e-6));
+}
+TEST_CASE("rolling histogram reports percentiles of its samples", "[histogram]") {
+    rolling_histogram histogram(100);
+    CHECK(histogram.summary().count == 0);
+    for (int64_t ms = 100; ms >= 1; ms--) {
+        histogram.record(ms * 1000000);
+    }
+    percentile_summary summary = histogram.summary();
+    CHECK(summary.count == 100);
+    check_percentile(summary.p50, 50e6);
+    check_percentile(summary.p95, 95e6);
+    check_percentile(summary.p99, 99e6);
+    check_near(summary.max, 100e6);
+}
+TEST_CASE("rolling histogram buckets short durations exactly", "[histogram]") {
+    rolling_histogram histogram(10);
+    for (int64_t ns = 0; ns < 8; ns++) {
+        histogram.record(ns);
+    }
+    percentile_summary summary = histogram.summary();
+    check_near(summary.p50, 3.0);
+    check_near(summary.max, 7.0);
+}
+TEST_CASE("rolling histogram only describes its window", "[histogram]") {
+    rolling_histogram histogram(4);
+    for (int i = 0; i < 4; i++) {
+        histogram.record(int64_t{1000});
+    }
+    for (int i = 0; i < 4; i++) {
+        histogram.record(int64_t{8000});
+    }
+    percentile_summary summary = histogram.summary();
+    CHECK(summary.count == 4);
+    check_percentile(summary.p50, 8000.0);
+    check_near(summary.max, 8000.0);
+}
+TEST_CASE("rolling histogram counts long durations in its last bucket", "[histogram]") {
+    rolling_histogram histogram(1);
+    histogram.record(int64_t{1} << 50);
+    percentile_summary summary = histogram.summary();
+    // the last bucket ends at 2^42ns
+    check_near(summary.p50, static_cast<double>((int64_t{1} << 42) - 1));
+    check_near(summary.max, static_cast<double>(int64_t{1} << 50));
+}
+
+// DYNAMIC RESOLUTION --------------------------------------------------------------------------------------------------
+constexpr int64_t target_gpu_ns = 16000000;
+// a GPU whose frame time is proportional to the pixels rendered, taking full_scale_ns at scale 1
+float settle_scale(dynamic_resolution_controller &controller, double full_scale_ns, int frames = 1000) {
+    for (int i = 0; i < frames; i++) {
+        double scale = controller.get_scale();
+        controller.update(static_cast<int64_t>(full_scale_ns * scale * scale));
+    }
+    return controller.get_scale();
+}
+TEST_CASE("dynamic resolution converges below the target GPU time", "[dynamic_resolution]") {
+    dynamic_resolution_controller controller(0.25f, 1.f, time_f{1.6e-2f});
+    CHECK(controller.get_scale() == 1.f);
+    float scale = settle_scale(controller, 2.0 * target_gpu_ns);
+    // 90% of the target at about sqrt(0.9 / 2) of the full resolution
+    CHECK(std::abs(scale - std::sqrt(0.45f)) < 0.03f);
+    CHECK(2.0 * target_gpu_ns * scale * scale <= target_gpu_ns);
+}
+TEST_CASE("dynamic resolution clamps the scale to its range", "[dynamic_resolution]") {
+    dynamic_resolution_controller slow(0.5f, 1.f, time_f{1.6e-2f});
+    CHECK(settle_scale(slow, 100.0 * target_gpu_ns) == 0.5f);
+    dynamic_resolution_controller fast(0.5f, 0.8f, time_f{1.6e-2f});
+    CHECK(settle_scale(fast, 0.1 * target_gpu_ns) == 0.8f);
+}
+TEST_CASE("dynamic resolution waits a few frames between changes", "[dynamic_resolution]") {
+    dynamic_resolution_controller controller(0.5f, 1.f, time_f{1.6e-2f});
+    for (int i = 0; i < 7; i++) {
+        CHECK(controller.update(10 * target_gpu_ns) == 1.f);
+    }
+    // the scale is lowered by at most 0.2 at once
+    CHECK(std::abs(controller.update(10 * target_gpu_ns) - 0.8f) < 1e-6f);
+}
+
+// FRAME PACER ---------------------------------------------------------------------------------------------------------
+TEST_CASE("frame pacer does nothing when disabled", "[frame_pacer]") {
+    frame_pacer pacer;
+    pacer.set_frame_rate(0.f);
+    auto now = frame_pacer::clock::time_point{} + std::chrono::seconds(10);
+    CHECK_FALSE(pacer.is_enabled());
+    CHECK(pacer.is_due(now));
+    pacer.start_frame(now);
+    CHECK(pacer.get_jitter().count() == 0);
+}
+TEST_CASE("frame pacer schedules frames a period apart", "[frame_pacer]") {
+    frame_pacer pacer;
+    pacer.set_frame_rate(100.f);
+    auto period = std::chrono::milliseconds(10);
+    auto start = frame_pacer::clock::time_point{} + std::chrono::seconds(10);
+    pacer.start_frame(start);
+    CHECK(pacer.next_deadline() == start + period);
+    CHECK_FALSE(pacer.is_due(start + period / 2));
+    CHECK(pacer.is_due(start + period));
+    // a frame starting late keeps the schedule and records how late it was
+    pacer.start_frame(start + period + std::chrono::milliseconds(2));
+    CHECK(pacer.next_deadline() == start + 2 * period);
+    REQUIRE(pacer.get_jitter().count() == 1);
+    check_near(pacer.get_jitter().summary().max, 2e6);
+}
+TEST_CASE("frame pacer restarts its schedule after a frame more than a period late", "[frame_pacer]") {
+    frame_pacer pacer;
+    pacer.set_frame_rate(100.f);
+    auto period = std::chrono::milliseconds(10);
+    auto start = frame_pacer::clock::time_point{} + std::chrono::seconds(10);
+    pacer.start_frame(start);
+    // instead of a burst of frames to catch up, the next frame is a period after the late one
+    auto late = start + 5 * period;
+    pacer.start_frame(late);
+    CHECK(pacer.next_deadline() == late + period);
+    CHECK(pacer.get_jitter().count() == 0);
+    CHECK_FALSE(pacer.is_due(late + period / 2));
+}
+
+// DOUBLE BUFFERED -----------------------------------------------------------------------------------------------------
+// Frames are the number of updates the renderer has published when update() writes and render() reads. Without
+// pipelined updates an update writes in frame f and is published before it is rendered in frame f + 1. With pipelined
+// updates the update of frame f is published and rendered in frame f while the next one is written in frame f too.
+TEST_CASE("double buffered values are read in the frame they are written without pipelining", "[double_buffered]") {
+    double_buffered<int> value(0);
+    value.write(0) = 10;
+    CHECK(value.read(1) == 10);
+    value.write(1) = 20;
+    CHECK(value.read(2) == 20);
+}
+TEST_CASE("double buffered values are read a frame after they are written with pipelining", "[double_buffered]") {
+    double_buffered<int> value(0);
+    value.write(1) = 10;
+    CHECK(value.read(1) == 0);
+    // each frame's state starts from the last one
+    CHECK(value.write(2) == 10);
+    value.write(2) = 20;
+    CHECK(value.read(2) == 10);
+    CHECK(value.read(3) == 20);
+}
+TEST_CASE("double buffered values stay current in frames they aren't written in", "[double_buffered]") {
+    double_buffered<int> value(0);
+    value.write(1) = 5;
+    CHECK(value.read(4) == 5);
+    CHECK(value.write(4) == 5);
+    CHECK(value.read(4) == 5);
+}
+
+// TASKS ---------------------------------------------------------------------------------------------------------------
+using task_log = std::vector<std::string>;
+task log_frames(task_log *log, std::string name, int frames) {
+    for (int i = 0; i < frames; i++) {
+        log->push_back(name + std::to_string(i));
+        co_await next_frame();
+    }
+}
+task wait_seconds(bool *resumed, time_f duration) {
+    co_await square::seconds(duration);
+    *resumed = true;
+}
+task fail_next_frame() {
+    co_await next_frame();
+    throw std::runtime_error("task failed");
+}
+struct test_asset {
+    bool ready = false;
+    bool failed = false;
+    bool is_ready() const { return ready; }
+    bool has_failed() const { return failed; }
+};
+task await_asset(const test_asset *asset, int *result) {
+    try {
+        co_await asset_ready(asset);
+        *result = 1;
+    } catch (const std::runtime_error &) {
+        *result = -1;
+    }
+}
+TEST_CASE("task scheduler resumes tasks in the order they were started", "[task]") {
+    task_scheduler scheduler;
+    task_log log;
+    task a = log_frames(&log, "a", 2);
+    task b = log_frames(&log, "b", 2);
+    scheduler.start(a);
+    scheduler.start(b);
+    // tasks run from the next run()
+    CHECK(log.empty());
+    auto now = task_scheduler::clock::now();
+    scheduler.run(now);
+    CHECK(log == task_log{"a0", "b0"});
+    scheduler.run(now);
+    CHECK(log == task_log{"a0", "b0", "a1", "b1"});
+    scheduler.run(now);
+    CHECK(a.done());
+    CHECK(b.done());
+    CHECK(scheduler.size() == 0);
+}
+TEST_CASE("task scheduler resumes tasks waiting for a time once it has passed", "[task]") {
+    task_scheduler scheduler;
+    bool resumed = false;
+    task t = wait_seconds(&resumed, time_f{1.f});
+    scheduler.start(t);
+    auto start = task_scheduler::clock::now();
+    scheduler.run(start);
+    scheduler.run(start + std::chrono::milliseconds(500));
+    CHECK_FALSE(resumed);
+    scheduler.run(start + std::chrono::seconds(1));
+    CHECK(resumed);
+}
+TEST_CASE("task scheduler doesn't resume paused tasks", "[task]") {
+    task_scheduler scheduler;
+    task_log log;
+    bool paused = true;
+    task t = log_frames(&log, "t", 1);
+    scheduler.start(t, &paused);
+    auto now = task_scheduler::clock::now();
+    scheduler.run(now);
+    CHECK(log.empty());
+    paused = false;
+    scheduler.run(now);
+    CHECK(log == task_log{"t0"});
+}
+TEST_CASE("task scheduler forgets tasks destroyed before they first ran", "[task]") {
+    task_scheduler scheduler;
+    task_log log;
+    {
+        task t = log_frames(&log, "t", 1);
+        scheduler.start(t);
+    }
+    scheduler.run(task_scheduler::clock::now());
+    CHECK(log.empty());
+    CHECK(scheduler.size() == 0);
+}
+TEST_CASE("task scheduler rethrows exceptions after resuming the other tasks", "[task]") {
+    task_scheduler scheduler;
+    task_log log;
+    task failing = fail_next_frame();
+    task other = log_frames(&log, "t", 2);
+    scheduler.start(failing);
+    scheduler.start(other);
+    auto now = task_scheduler::clock::now();
+    scheduler.run(now);
+    CHECK_THROWS_AS(scheduler.run(now), std::runtime_error);
+    CHECK(failing.done());
+    CHECK(log == task_log{"t0", "t1"});
+    CHECK(scheduler.size() == 1);
+}
+TEST_CASE("tasks awaiting an asset resume when it is ready or has failed", "[task]") {
+    task_scheduler scheduler;
+    test_asset loaded, broken;
+    int loaded_result = 0, broken_result = 0;
+    task a = await_asset(&loaded, &loaded_result);
+    task b = await_asset(&broken, &broken_result);
+    scheduler.start(a);
+    scheduler.start(b);
+    auto now = task_scheduler::clock::now();
+    scheduler.run(now);
+    CHECK(loaded_result == 0);
+    CHECK(broken_result == 0);
+    loaded.ready = true;
+    broken.failed = true;
+    scheduler.run(now);
+    CHECK(loaded_result == 1);
+    CHECK(broken_result == -1);
+}
+
+// PHYSICS SCHEDULE ----------------------------------------------------------------------------------------------------
+// powers of two keep the sums of dts exact
+const time_f update_dt{1.f / 64.f};
+// the update of each run of the schedule in the given number of updates
+std::vector<size_t> run_updates(physics_schedule &schedule, size_t updates) {
+    std::vector<size_t> result;
+    for (size_t i = 0; i < updates; i++) {
+        result.insert(result.end(), schedule.advance(update_dt), i);
+    }
+    return result;
+}
+TEST_CASE("physics schedule without a rate runs once per update", "[physics_schedule]") {
+    physics_schedule schedule;
+    CHECK(run_updates(schedule, 4) == std::vector<size_t>{0, 1, 2, 3});
+    CHECK(schedule.step(update_dt).as_seconds() == update_dt.as_seconds());
+}
+TEST_CASE("physics schedule with a high rate runs several times per update", "[physics_schedule]") {
+    physics_schedule schedule(1024.f);
+    for (int i = 0; i < 64; i++) {
+        CHECK(schedule.advance(update_dt) == 16);
+    }
+    CHECK(schedule.step(update_dt).as_seconds() == 1.f / 1024.f);
+}
+TEST_CASE("physics schedule with a low rate runs every few updates", "[physics_schedule]") {
+    physics_schedule schedule(8.f);
+    std::vector<size_t> updates = run_updates(schedule, 64);
+    REQUIRE(updates.size() == 8);
+    for (size_t i = 1; i < updates.size(); i++) {
+        CHECK(updates[i] - updates[i - 1] == 8);
+    }
+    CHECK(schedule.step(update_dt).as_seconds() == 1.f / 8.f);
+}
+TEST_CASE("physics schedules attached together start at different phases", "[physics_schedule]") {
+    physics_schedule a(8.f), b(8.f);
+    std::vector<size_t> a_updates = run_updates(a, 8), b_updates = run_updates(b, 8);
+    REQUIRE(a_updates.size() == 1);
+    REQUIRE(b_updates.size() == 1);
+    CHECK(a_updates[0] != b_updates[0]);
+}
+
+// SYSTEM SCHEDULER ----------------------------------------------------------------------------------------------------
+// tag components, the scheduler only looks at the declared types
+struct position {};
+struct velocity {};
+void count_run(const physics_run &r) { *static_cast<int *>(r.entity) += static_cast<int>(r.runs); }
+physics_run scheduled_run(const system_access *access, int &entity) {
+    return {.access = access, .entity = &entity, .runs = 1, .run = count_run};
+}
+size_t level_count(const std::vector<physics_run> &runs) {
+    thread_pool jobs(2);
+    system_scheduler scheduler;
+    scheduler.run(runs, jobs, [](auto &&job) { job(); });
+    return scheduler.get_level_count();
+}
+TEST_CASE("system scheduler runs accesses of different entities together", "[system_scheduler]") {
+    system_access writes_position;
+    writes_position.writes<position>();
+    int a = 0, b = 0;
+    CHECK(level_count({scheduled_run(&writes_position, a), scheduled_run(&writes_position, b)}) == 1);
+    CHECK(a == 1);
+    CHECK(b == 1);
+}
+TEST_CASE("system scheduler orders conflicting accesses of an entity", "[system_scheduler]") {
+    system_access writes_position, reads_position, reads_velocity;
+    writes_position.writes<position>();
+    reads_position.reads<position>();
+    reads_velocity.reads<velocity>();
+    int a = 0;
+    CHECK(level_count({scheduled_run(&writes_position, a), scheduled_run(&reads_position, a)}) == 2);
+    CHECK(level_count({scheduled_run(&reads_position, a), scheduled_run(&reads_position, a)}) == 1);
+    CHECK(level_count({scheduled_run(&writes_position, a), scheduled_run(&reads_velocity, a)}) == 1);
+}
+TEST_CASE("system scheduler orders shared accesses with the accesses on every entity", "[system_scheduler]") {
+    system_access writes_position, reads_shared_position, writes_shared_position, reads_position;
+    writes_position.writes<position>();
+    reads_shared_position.reads_shared<position>();
+    writes_shared_position.writes_shared<position>();
+    reads_position.reads<position>();
+    int a = 0, b = 0;
+    CHECK(level_count({scheduled_run(&writes_position, a), scheduled_run(&reads_shared_position, b)}) == 2);
+    CHECK(level_count({scheduled_run(&writes_shared_position, a), scheduled_run(&reads_position, b)}) == 2);
+    CHECK(level_count({scheduled_run(&reads_position, a), scheduled_run(&reads_shared_position, b)}) == 1);
+}
+TEST_CASE("system scheduler runs systems without declared access alone", "[system_scheduler]") {
+    system_access writes_position;
+    writes_position.writes<position>();
+    int a = 0, b = 0, c = 0;
+    CHECK(level_count({scheduled_run(&writes_position, a), scheduled_run(nullptr, b),
+                       scheduled_run(&writes_position, c)}) == 3);
+    CHECK(a + b + c == 3);
+}